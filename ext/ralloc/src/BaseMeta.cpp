@@ -14,6 +14,7 @@
 #include <sys/mman.h>
 
 #include <string>
+#include <algorithm>
 #include <chrono> 
 #include <iostream>
 
@@ -359,11 +360,6 @@ void BaseMeta::flush_cache(size_t sc_idx, TCacheBin* cache) {
     ProcHeap* heap = &heaps[sc_idx];
     const SizeClassData* sc = get_sizeclass_by_idx(sc_idx);
     uint32_t const sb_size = sc->sb_size;
-    uint32_t const block_size = sc->block_size;
-    // after CAS, desc might become empty and
-    //  concurrently reused, so store maxcount
-    uint32_t const maxcount = sc->get_block_num();
-    (void)maxcount; // suppress unused warning
 
     // @todo: optimize
     // in the normal case, we should be able to return several
@@ -393,49 +389,61 @@ void BaseMeta::flush_cache(size_t sc_idx, TCacheBin* cache) {
 
         cache->pop_list(static_cast<char*>(*(pptr<char>*)tail), block_count);
 
-        // add list to desc, update anchor
-        uint32_t idx = compute_idx(superblock, head, sc_idx);
-
-        Anchor oldanchor = desc->anchor.load();
-        Anchor newanchor;
-        do {
-            // update anchor.avail
-            char* next = (char*)(superblock + oldanchor.avail * block_size);
-            *(pptr<char>*)tail = next;
-
-            newanchor = oldanchor;
-            newanchor.avail = idx;
-            // state updates
-            // don't set SB_PARTIAL if state == SB_ACTIVE
-            if (oldanchor.state == SB_FULL)
-                newanchor.state = SB_PARTIAL;
-            // this can't happen with SB_ACTIVE
-            // because of reserved blocks
-            assert(oldanchor.count < desc->maxcount);
-            if (oldanchor.count + block_count == desc->maxcount) {
-                newanchor.count = desc->maxcount - 1;
-                newanchor.state = SB_EMPTY; // can free superblock
-            }
-            else
-                newanchor.count += block_count;
+        free_to_sb(desc, superblock, head, tail, block_count, sc_idx);
+    }
+}
+
+void BaseMeta::free_to_sb(Descriptor* desc, char* superblock, char* head, char* tail,
+    uint32_t block_count, size_t sc_idx) {
+    const SizeClassData* sc = get_sizeclass_by_idx(sc_idx);
+    uint32_t const block_size = sc->block_size;
+    // after CAS, desc might become empty and
+    //  concurrently reused, so store maxcount
+    uint32_t const maxcount = sc->get_block_num();
+    (void)maxcount; // suppress unused warning
+
+    // add list to desc, update anchor
+    uint32_t idx = compute_idx(superblock, head, sc_idx);
+
+    Anchor oldanchor = desc->anchor.load();
+    Anchor newanchor;
+    do {
+        // update anchor.avail
+        char* next = (char*)(superblock + oldanchor.avail * block_size);
+        *(pptr<char>*)tail = next;
+
+        newanchor = oldanchor;
+        newanchor.avail = idx;
+        // state updates
+        // don't set SB_PARTIAL if state == SB_ACTIVE
+        if (oldanchor.state == SB_FULL)
+            newanchor.state = SB_PARTIAL;
+        // this can't happen with SB_ACTIVE
+        // because of reserved blocks
+        assert(oldanchor.count < desc->maxcount);
+        if (oldanchor.count + block_count == desc->maxcount) {
+            newanchor.count = desc->maxcount - 1;
+            newanchor.state = SB_EMPTY; // can free superblock
         }
-        while (!desc->anchor.compare_exchange_weak(oldanchor, newanchor));
-
-        // after last CAS, can't reliably read any desc fields
-        // as desc might have become empty and been concurrently reused
-        assert(oldanchor.avail < maxcount || oldanchor.state == SB_FULL);
-        assert(newanchor.avail < maxcount);
-        assert(newanchor.count < maxcount);
-
-        // CAS success
-        if (oldanchor.state == SB_FULL) {
-            if(newanchor.state == SB_EMPTY) {
-                // this sb becomes empty from full
-                small_sb_retire(superblock, SBSIZE);
-            } else {
-                // this sb becomes partial from full
-                heap_push_partial(desc);
-            }
+        else
+            newanchor.count += block_count;
+    }
+    while (!desc->anchor.compare_exchange_weak(oldanchor, newanchor));
+
+    // after last CAS, can't reliably read any desc fields
+    // as desc might have become empty and been concurrently reused
+    assert(oldanchor.avail < maxcount || oldanchor.state == SB_FULL);
+    assert(newanchor.avail < maxcount);
+    assert(newanchor.count < maxcount);
+
+    // CAS success
+    if (oldanchor.state == SB_FULL) {
+        if(newanchor.state == SB_EMPTY) {
+            // this sb becomes empty from full
+            small_sb_retire(superblock, SBSIZE);
+        } else {
+            // this sb becomes partial from full
+            heap_push_partial(desc);
         }
     }
 }
@@ -766,6 +774,82 @@ void BaseMeta::do_free(void* ptr, TCaches& t_caches){
     cache->push_block((char*)ptr);
 }
 
+void BaseMeta::do_free_batch(void** ptrs, size_t n, TCaches& t_caches){
+    size_t m = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (ptrs[i] != nullptr)
+            ptrs[m++] = ptrs[i];
+    }
+    if (m == 0) return;
+    // make blocks of a superblock adjacent, so that each superblock is
+    // looked up, and its anchor updated, once. A counting sort on the
+    // superblock index is much cheaper than sorting the blocks, unless
+    // they are spread over too many superblocks.
+    uint64_t lo = UINT64_MAX, hi = 0;
+    for (size_t i = 0; i < m; i++) {
+        uint64_t sb = (uint64_t)ptrs[i] >> SB_SHIFT;
+        lo = min(lo, sb);
+        hi = max(hi, sb);
+    }
+    if (hi - lo < 4 * m) {
+        std::vector<size_t> start(hi - lo + 2, 0);
+        for (size_t i = 0; i < m; i++)
+            start[((uint64_t)ptrs[i] >> SB_SHIFT) - lo + 1]++;
+        for (size_t j = 1; j < start.size(); j++)
+            start[j] += start[j - 1];
+        std::vector<void*> grouped(m);
+        for (size_t i = 0; i < m; i++)
+            grouped[start[((uint64_t)ptrs[i] >> SB_SHIFT) - lo]++] = ptrs[i];
+        std::copy(grouped.begin(), grouped.end(), ptrs);
+    } else {
+        std::sort(ptrs, ptrs + m);
+    }
+
+    size_t i = 0;
+    while (i < m) {
+        char* head = (char*)ptrs[i];
+        assert(_rgs->in_range(SB_IDX,head));
+        Descriptor* desc = desc_lookup(head);
+        size_t sc_idx = desc->heap.to_addr(_rgs)->sc_idx;
+        char* superblock = desc->superblock.to_addr(_rgs);
+
+        // large allocation case
+        if (UNLIKELY(!sc_idx)) {
+            large_sb_retire(superblock, desc->block_size);
+            i++;
+            continue;
+        }
+
+        TCacheBin* cache = &t_caches.t_cache[sc_idx];
+        const SizeClassData* sc = get_sizeclass_by_idx(sc_idx);
+        char* sb_end = superblock + sc->sb_size;
+        auto in_sb = [&](void* ptr) {
+            return (char*)ptr >= superblock && (char*)ptr < sb_end;
+        };
+
+        // keep blocks in the thread cache while there's room, as
+        // do_free does
+        while (i < m && in_sb(ptrs[i]) &&
+            cache->get_block_num() < sc->cache_block_num) {
+            cache->push_block((char*)ptrs[i++]);
+        }
+        if (i == m || !in_sb(ptrs[i]))
+            continue;
+
+        // link the rest of this superblock's blocks and hand them
+        // back all at once
+        head = (char*)ptrs[i];
+        char* tail = head;
+        uint32_t block_count = 1;
+        for (i++; i < m && in_sb(ptrs[i]); i++) {
+            *(pptr<char>*)tail = (char*)ptrs[i];
+            tail = (char*)ptrs[i];
+            ++block_count;
+        }
+        free_to_sb(desc, superblock, head, tail, block_count, sc_idx);
+    }
+}
+
 /*
  * function GarbageCollection::operator()
  * 
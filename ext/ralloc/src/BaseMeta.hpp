@@ -431,6 +431,10 @@ public:
     }
     void* do_malloc(size_t size, TCaches& t_caches);
     void do_free(void* ptr, TCaches& t_caches);
+    // free n blocks at once: ptrs is reordered so that blocks of a
+    // superblock are adjacent, and they are spliced into its free list
+    // with a single CAS once the thread cache is full
+    void do_free_batch(void** ptrs, size_t n, TCaches& t_caches);
     // this func can be called only once during restart
     bool is_dirty();
     // set_dirty must be called AFTER is_dirty
@@ -518,6 +522,10 @@ private:
 
     // func on cache
     void fill_cache(size_t sc_idx, TCacheBin* cache);
+    // give a list of block_count blocks, linked from head to tail, back
+    // to the free list of the superblock desc describes
+    void free_to_sb(Descriptor* desc, char* superblock, char* head, char* tail,
+        uint32_t block_count, size_t sc_idx);
 public:
     // we need to call this function to flush TLS cache during exit
     void flush_cache(size_t sc_idx, TCacheBin* cache);
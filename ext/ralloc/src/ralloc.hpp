@@ -61,6 +61,12 @@ public:
         assert(tid_!=-1 && tid_<thd_num && "tid out of range!");
         base_md->do_free(ptr,t_caches[tid_]);
     }
+    // free n blocks, cheaper than one by one for large n. Reorders ptrs.
+    inline void deallocate_batch(void** ptrs, size_t n, int tid_=tid){
+        assert(initialized&&"Ralloc isn't initialized!");
+        assert(tid_!=-1 && tid_<thd_num && "tid out of range!");
+        base_md->do_free_batch(ptrs,n,t_caches[tid_]);
+    }
     void* reallocate(void* ptr, size_t new_size, int tid_=tid);
 
     inline void* set_root(void* ptr, uint64_t i){
@@ -51,6 +51,9 @@ char *item_cachedump(const unsigned int slabs_clsid, const unsigned int limit, u
 void do_item_stats_add_crawl(const int i, const uint64_t reclaimed,
         const uint64_t unfetched, const uint64_t checked);
 void items_init();
+#ifdef MONTAGE
+uint64_t items_recover_montage(void);
+#endif
 
 /* stats getter for slab automover */
 struct item_stats_automove{
@@ -11,6 +11,12 @@
 #include <assert.h>
 #include <unistd.h>
 #include <poll.h>
+#ifdef MONTAGE
+#include <algorithm>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#endif
 
 /* Forward Declarations */
 static void item_link_q(item *it);
@@ -391,6 +397,98 @@ int do_item_link(item *it, const uint32_t hv) {
   return 1;
 }
 
+#ifdef MONTAGE
+/* Rebuild the hash table and the LRU lists from the items Montage
+ * recovered on restart. The index isn't persistent in this build and
+ * starts out empty, so every recovered item is linked anew: items are
+ * hashed in parallel, then each LRU is relinked by one thread, oldest
+ * access first so that the newest ends up at the head. Items whose key
+ * is already linked are freed.
+ * Returns the number of items linked. */
+uint64_t items_recover_montage(void) {
+  std::unordered_map<uint64_t, PBlk*> *recovered = get_recovered_pblks();
+  if (recovered == NULL)
+    return 0;
+  std::vector<item*> all;
+  all.reserve(recovered->size());
+  for (auto &kv : *recovered)
+    all.push_back((item*)kv.second);
+
+  int thd_num = std::max(1, global_recoverable->get_rec_thd());
+  // items hashed by each thread, per slab class
+  std::vector<std::vector<std::vector<item*>>> by_class(thd_num,
+      std::vector<std::vector<item*>>(SLAB_CLASSES));
+  // duplicates found by each thread, freed once hashing is done
+  std::vector<std::vector<item*>> dups(thd_num);
+  std::atomic<uint64_t> linked(0);
+  std::vector<std::thread> workers;
+  for (int t = 0; t < thd_num; t++) {
+    workers.emplace_back([&, t]() {
+      uint64_t bytes = 0, cnt = 0;
+      for (size_t i = all.size() * t / thd_num; i < all.size() * (t + 1) / thd_num; i++) {
+        item *it = all[i];
+        uint32_t hv = tcd_hash(ITEM_key(it), it->nkey);
+        item_lock(hv);
+        // a key is stored once per epoch, so this shouldn't happen
+        bool dup = assoc_find(ITEM_key(it), it->nkey, hv) != NULL;
+        if (!dup) {
+          it->it_flags = (it->it_flags & ITEM_CAS) | ITEM_LINKED;
+          it->refcount = 1;
+          assoc_insert(it, hv);
+        }
+        item_unlock(hv);
+        if (dup) {
+          dups[t].push_back(it);
+          continue;
+        }
+        by_class[t][it->slabs_clsid].push_back(it);
+        bytes += ITEM_ntotal(it);
+        cnt++;
+      }
+      __thread_stats[stats_id].curr_bytes.fetch_add(bytes);
+      __thread_stats[stats_id].curr_items.fetch_add(cnt);
+      __thread_stats[stats_id].total_items.fetch_add(cnt);
+      linked.fetch_add(cnt);
+    });
+  }
+  for (auto &w : workers)
+    w.join();
+  workers.clear();
+  // reclaim duplicates like any other unlinked item, so they don't
+  // come back on the next restart
+  for (auto &v : dups) {
+    for (item *it : v) {
+      it->it_flags &= ITEM_CAS;
+      it->refcount = 0;
+      item_free(it);
+    }
+  }
+
+  for (int t = 0; t < thd_num; t++) {
+    workers.emplace_back([&, t]() {
+      for (int id = t; id < SLAB_CLASSES; id += thd_num) {
+        std::vector<item*> q;
+        for (auto &v : by_class)
+          q.insert(q.end(), v[id].begin(), v[id].end());
+        std::sort(q.begin(), q.end(), [](item *a, item *b) {
+          return a->time < b->time;
+        });
+        pthread_mutex_lock(&lru_locks[id]);
+        for (item *it : q) {
+          do_item_link_q(it);
+          // access times are relative to the previous process
+          it->time = *current_time;
+        }
+        pthread_mutex_unlock(&lru_locks[id]);
+      }
+    });
+  }
+  for (auto &w : workers)
+    w.join();
+  return linked.load();
+}
+#endif
+
 void do_item_unlink(item *it, const uint32_t hv) {
   if ((it->it_flags & ITEM_LINKED) != 0) {
     it->it_flags &= ~ITEM_LINKED;
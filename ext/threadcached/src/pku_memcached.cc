@@ -5,6 +5,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <chrono>
 
 #ifdef USE_HODOR
 #include <hodor.h>
@@ -414,19 +415,34 @@ void memcached_init(int thd_num){
   char* heap_prefix = (char*) malloc(L_cuserid+6);
   cuserid(heap_prefix);
   strcat(heap_prefix, "_memcached");
+#ifdef MONTAGE
+  // Only items are persistent in the Montage build. The index kept in
+  // this heap (hash table, LRU lists, stats...) isn't consistent with
+  // them after a crash, so it always starts empty and is rebuilt from
+  // the recovered items below.
+  for (const char* part : {"_desc", "_sb", "_basemd"}) {
+    remove((std::string(HEAPFILE_PREFIX) + heap_prefix + part).c_str());
+  }
+#endif
   is_restart = RP_init(heap_prefix, MEMORY_MAX, thd_num);
   free(heap_prefix);
 #else
   is_restart = pm_init();
 #endif
   agnostic_init();
-  if (is_restart) {
 #ifdef MONTAGE
-    assert(0&&"Montage memcached recovery routine not implemented!");
+  if (get_recovered_pblks() != nullptr) {
+    auto begin = std::chrono::high_resolution_clock::now();
+    uint64_t cnt = items_recover_montage();
+    auto end = std::chrono::high_resolution_clock::now();
+    auto dur_ms = std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count();
+    printf("Spent %ldms relinking items(%lu)\n", (long)dur_ms, (unsigned long)cnt);
+  }
 #else
+  if (is_restart) {
     pm_recover();
-#endif
   }
+#endif
   fetch_ptrs = (item**)pm_malloc(sizeof(item*)*128);
 }
 
@@ -10,14 +10,19 @@
 
 #include <string>
 #include "db/tcd_db.h"
+#include "db/montage_tree_db.h"
 
 using namespace std;
 using ycsbc::DB;
 using ycsbc::DBFactory;
 
-DB* DBFactory::CreateDB(utils::Properties &props) {
+DB* DBFactory::CreateDB(utils::Properties &props, GlobalTestConfig *gtc) {
   if (props["dbname"] == "tcd") {
     return new TCDDB; 
+#ifdef MONTAGE
+  } else if (props["dbname"] == "montage_tree") {
+    return new ycsbc::MontageTreeDB(gtc);
+#endif
   } else return NULL;
 }
 
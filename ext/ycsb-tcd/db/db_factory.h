@@ -12,11 +12,14 @@
 #include "core/db.h"
 #include "core/properties.h"
 
+class GlobalTestConfig;
+
 namespace ycsbc {
 
 class DBFactory {
  public:
-  static DB* CreateDB(utils::Properties &props);
+  // gtc is for Montage-backed stores
+  static DB* CreateDB(utils::Properties &props, GlobalTestConfig *gtc = nullptr);
 };
 
 } // ycsbc
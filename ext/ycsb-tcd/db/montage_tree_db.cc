@@ -0,0 +1,60 @@
+//
+//  montage_tree_db.cc
+//  YCSB-C
+//
+
+// Montage builds only
+#ifdef MONTAGE
+
+#include "montage_tree_db.h"
+#include <utility>
+
+namespace ycsbc {
+  MontageTreeDB::MontageTreeDB(GlobalTestConfig *gtc) {
+    // recovers the tree on restart
+    tree_ = new MontageBPlusTree<std::string, std::string>(gtc);
+  }
+
+  MontageTreeDB::~MontageTreeDB() {
+    delete tree_;
+  }
+
+  void MontageTreeDB::Init(int tid) {
+    static_cast<Recoverable*>(tree_)->init_thread(tid);
+  }
+
+  int MontageTreeDB::Read(const std::string &table, const std::string &key,
+      const std::vector<std::string> *fields,
+      std::vector<KVPair> &result, int tid) {
+    optional<std::string> val = tree_->get(key, tid);
+    if (!val) return DB::kErrorNoData;
+    result.push_back(std::make_pair(std::string("field0"), *val));
+    return DB::kOK;
+  }
+
+  int MontageTreeDB::Scan(const std::string &table, const std::string &key,
+      int len, const std::vector<std::string> *fields,
+      std::vector<std::vector<KVPair>> &result, int tid) {
+    tree_->scan(key, len, [&](const std::string &k, const std::string &v) {
+      result.push_back({std::make_pair(std::string("field0"), v)});
+    }, tid);
+    return DB::kOK;
+  }
+
+  int MontageTreeDB::Update(const std::string &table, const std::string &key,
+      std::vector<KVPair> &values, int tid) {
+    tree_->put(key, values[0].second, tid);
+    return DB::kOK;
+  }
+
+  int MontageTreeDB::Insert(const std::string &table, const std::string &key,
+      std::vector<KVPair> &values, int tid) {
+    return Update(table, key, values, tid);
+  }
+
+  int MontageTreeDB::Delete(const std::string &table, const std::string &key, int tid) {
+    return tree_->remove(key, tid) ? DB::kOK : DB::kErrorNoData;
+  }
+};
+
+#endif
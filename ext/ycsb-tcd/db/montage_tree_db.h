@@ -0,0 +1,54 @@
+//
+//  montage_tree_db.h
+//  YCSB-C
+//
+//  An ordered store on Montage, for workloads with scans (e.g., E).
+//
+
+#ifndef YCSB_C_MONTAGE_TREE_DB_H_
+#define YCSB_C_MONTAGE_TREE_DB_H_
+
+#include "core/db.h"
+#include <string>
+#include <vector>
+
+#ifdef MONTAGE
+#include "TestConfig.hpp"
+#include "MontageBPlusTree.hpp"
+
+namespace ycsbc {
+
+// One record per key in a MontageBPlusTree; like TCDDB, records hold a
+// single field.
+class MontageTreeDB : public DB {
+  public:
+  MontageTreeDB(GlobalTestConfig *gtc);
+  ~MontageTreeDB();
+
+  void Init(int tid);
+
+  int Read(const std::string &table, const std::string &key,
+      const std::vector<std::string> *fields,
+      std::vector<KVPair> &result, int tid);
+
+  int Scan(const std::string &table, const std::string &key,
+      int len, const std::vector<std::string> *fields,
+      std::vector<std::vector<KVPair>> &result, int tid);
+
+  int Update(const std::string &table, const std::string &key,
+      std::vector<KVPair> &values, int tid);
+
+  int Insert(const std::string &table, const std::string &key,
+      std::vector<KVPair> &values, int tid);
+
+  int Delete(const std::string &table, const std::string &key, int tid);
+
+  private:
+  MontageBPlusTree<std::string, std::string> *tree_;
+};
+
+} // ycsbc
+
+#endif // MONTAGE
+
+#endif // YCSB_C_MONTAGE_TREE_DB_H_
@@ -45,7 +45,9 @@ namespace ycsbc {
   int TCDDB::Scan(const std::string &table, const std::string &key,
       int len, const std::vector<std::string> *fields,
       std::vector<std::vector<KVPair>> &result, int tid) {
-    assert(0 && "This is not implemented");
+    // memcached keeps no key order; run scans on an ordered store
+    // instead (-db montage_tree in Montage builds).
+    assert(0 && "Scan is not supported by tcd");
     return 0;
   }
 
@@ -95,6 +95,10 @@ int main(const int argc, char *argv[]) {
   utils::Properties props;
   string file_name = ParseCommandLine(argc, argv, props);
   const int num_threads = stoi(props.GetProperty("threadcount", "1"));
+  // other stores run without memcached
+  const bool tcd = props["dbname"] == "tcd";
+  // times start-up, which includes recovery on restart
+  utils::Timer<double> init_timer;
 #ifdef MONTAGE
   // Ralloc init and close are already handled by memcached_init() 
   // init epoch system with artificial gtc, only for passing t and d
@@ -133,19 +137,23 @@ int main(const int argc, char *argv[]) {
   hwloc_get_type_depth(gtc.topology, HWLOC_OBJ_PU));
   std::cout<<"initial affinity built"<<std::endl;
   gtc.buildAffinity(gtc.affinities);
-  pds::init(&gtc);
-#endif
-  memcached_init(num_threads);
-  if (do_cache_test_flag){
-    do_cache_test();
-    memcached_close();
-  }
-
+  init_timer.Start();
+  if (tcd) pds::init(&gtc);
+  ycsbc::DB *db = ycsbc::DBFactory::CreateDB(props, &gtc);
+#else
+  init_timer.Start();
   ycsbc::DB *db = ycsbc::DBFactory::CreateDB(props);
+#endif
   if (!db) {
     cout << "Unknown database name " << props["dbname"] << endl;
     exit(0);
   }
+  if (tcd) memcached_init(num_threads);
+  cout << "# Init time (ms):\t" << init_timer.End() * 1000 << endl;
+  if (do_cache_test_flag){
+    do_cache_test();
+    memcached_close();
+  }
   ycsbc::CoreWorkload wl;
   wl.Init(props);
 
@@ -187,7 +195,7 @@ int main(const int argc, char *argv[]) {
   cout << total_ops / duration / 1000 << endl;
   cerr << num_threads << "," << total_ops / duration / 1000;
   fflush(stdout);
-  memcached_close();
+  if (tcd) memcached_close();
 }
 
 string ParseCommandLine(int argc, char *argv[], utils::Properties &props) {
@@ -281,6 +289,8 @@ void UsageMessage(const char *command) {
   cout << "Options:" << endl;
   cout << "  -t n: execute using n threads (default: 1)" << endl;
   cout << "  -db dbname: specify the name of the DB to use (default: basic)" << endl;
+  cout << "              tcd (threadcached), or montage_tree (ordered, with scans;" << endl;
+  cout << "              Montage builds only)" << endl;
   cout << "  -P propertyfile: load properties from the given file. Multiple files can" << endl;
   cout << "                   be specified, and will be processed in the order specified" << endl;
 }
@@ -27,7 +27,7 @@ for file_name in ${workloads[@]}; do
   for OPT in "montage" "nvm" "dram"; do
     # cd ../ycsb-tcd
     make clean;OPT=$OPT make
-    for tn in ${threads[@]}; do
+    for tn in ${THREADS[@]}; do
       for db_name in ${db_names[@]}; do
         for ((i=1; i<=repeat_num; ++i)); do
           rm -rf /mnt/pmem/${USER}*
@@ -41,3 +41,36 @@ for file_name in ${workloads[@]}; do
     done
   done
 done
+
+# restart time: load the store, then start again on the same heap and
+# time start-up, which includes recovery ("# Init time" from ycsbc)
+restart_file="$outfile_dir/ycsbc_restart.csv"
+[ -f "$restart_file" ] && mv "$restart_file" "$restart_file.old"
+echo "thread,init_ms,option" > "$restart_file"
+for OPT in "montage" "nvm"; do
+  make clean;OPT=$OPT make
+  for tn in ${THREADS[@]}; do
+    for ((i=1; i<=repeat_num; ++i)); do
+      rm -rf /mnt/pmem/${USER}*
+      echo "Restarting $OPT with $tn threads"
+      ./ycsbc -t $tn -db tcd -P workloads/workloada.spec 1>/dev/null 2>&1
+      init_ms=$(./ycsbc -t $tn -db tcd -P workloads/workloada.spec 2>/dev/null | grep "# Init time" | cut -f2)
+      echo "$tn,$init_ms,$OPT" >> "$restart_file"
+    done
+  done
+done
+
+# workload E (short scans) on the ordered Montage store; threadcached
+# keeps no key order
+scan_file="$outfile_dir/ycsbc_e.csv"
+[ -f "$scan_file" ] && mv "$scan_file" "$scan_file.old"
+echo "thread,kops,option" > "$scan_file"
+make clean;OPT=montage make
+for tn in ${THREADS[@]}; do
+  for ((i=1; i<=repeat_num; ++i)); do
+    rm -rf /mnt/pmem/${USER}*
+    echo "Running montage_tree workload e with $tn threads"
+    ./ycsbc -t $tn -db montage_tree -P workloads/workloade.spec 2>/tmp/ycsbc_e 1> /dev/null
+    echo "$(cat /tmp/ycsbc_e),montage_tree" >> "$scan_file"
+  done
+done
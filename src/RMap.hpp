@@ -20,8 +20,12 @@ limitations under the License.
 #ifndef RMAP_HPP
 #define RMAP_HPP
 
+#include <functional>
 #include <string>
+#include <utility>
+#include <vector>
 #include "Rideable.hpp"
+#include "ReadGuard.hpp"
 
 #include "optional.hpp"
 
@@ -50,6 +54,46 @@ public:
     // if the key is already present in the map
     // returns : the replaced value, or NULL if replace was unsuccessful
     virtual optional<V> replace(K key, V val, int tid)=0;
+
+    // Puts each pair of kvs in order
+    // returns : for each pair, what put would have returned
+    virtual std::vector<optional<V>> put_batch(const std::vector<std::pair<K,V>>& kvs, int tid){
+        std::vector<optional<V>> ret;
+        ret.reserve(kvs.size());
+        for (const auto& kv : kvs){
+            ret.push_back(put(kv.first, kv.second, tid));
+        }
+        return ret;
+    }
+
+    // Gets each key of keys in order
+    // returns : for each key, what get would have returned
+    virtual std::vector<optional<V>> get_batch(const std::vector<K>& keys, int tid){
+        std::vector<optional<V>> ret;
+        ret.reserve(keys.size());
+        for (const auto& k : keys){
+            ret.push_back(get(k, tid));
+        }
+        return ret;
+    }
+
+    // Loads the pairs next yields into an empty map in one build
+    // instead of key by key; next returns false once it is out of
+    // pairs. No other operation may run concurrently.
+    // returns : the number of keys loaded, or -1 if the map has no
+    // such build or is not empty, in which case next is never called
+    virtual int bulk_load(std::function<bool(std::pair<K,V>&)> next, int tid){
+        return -1;
+    }
+
+    // Reads the value of key in place instead of copying it out; see
+    // ReadGuard. Only maps whose has_view() returns true support it.
+    virtual bool has_view(){
+        return false;
+    }
+    virtual ReadGuard get_view(K key, int tid){
+        return ReadGuard();
+    }
 };
 
 #endif   
@@ -0,0 +1,22 @@
+#ifndef RORDEREDMAP_HPP
+#define RORDEREDMAP_HPP
+
+#include <cstddef>
+#include <functional>
+#include "RMap.hpp"
+
+// A map that keeps its keys in order and can visit them in order.
+template <class K, class V> class ROrderedMap : public RMap<K,V>{
+public:
+    typedef std::function<void(const K&, const V&)> Visitor;
+
+    // Calls f(key, val) for each key in [lo, hi), in order
+    // returns : the number of keys visited
+    virtual size_t range(const K& lo, const K& hi, Visitor f, int tid)=0;
+
+    // Calls f(key, val) for the first n keys from lo on, in order
+    // returns : the number of keys visited
+    virtual size_t scan(const K& lo, size_t n, Visitor f, int tid)=0;
+};
+
+#endif
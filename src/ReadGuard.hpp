@@ -0,0 +1,60 @@
+#ifndef READ_GUARD_HPP
+#define READ_GUARD_HPP
+
+#include <string_view>
+
+// A string value read in place by a map's get_view(), without copying
+// it out. The map keeps whatever protects the value from being
+// changed or freed (a bucket lock, a reclamation reservation...) until
+// the guard is released or destroyed, so keep guards short-lived and
+// don't run other ops of the same map in this thread meanwhile.
+//
+//     ReadGuard g = m->get_view(key, tid);
+//     if (g) consume(g.value());
+class ReadGuard{
+public:
+    typedef void (*Release)(void* ds, void* arg, int tid);
+private:
+    std::string_view val;
+    bool found = false;
+    Release release_fn = nullptr;
+    void* ds = nullptr;
+    void* arg = nullptr;
+    int tid = -1;
+public:
+    ReadGuard(){}
+    // release_fn(ds, arg, tid) lets go of what the map holds.
+    ReadGuard(Release release_fn_, void* ds_, void* arg_, int tid_):
+        release_fn(release_fn_), ds(ds_), arg(arg_), tid(tid_){}
+    ReadGuard(const ReadGuard&) = delete;
+    ReadGuard& operator=(const ReadGuard&) = delete;
+    ReadGuard(ReadGuard&& oth): val(oth.val), found(oth.found),
+        release_fn(oth.release_fn), ds(oth.ds), arg(oth.arg), tid(oth.tid){
+        oth.release_fn = nullptr;
+    }
+    ~ReadGuard(){
+        release();
+    }
+
+    void set(std::string_view v){
+        val = v;
+        found = true;
+    }
+    void release(){
+        if (release_fn){
+            release_fn(ds, arg, tid);
+            release_fn = nullptr;
+        }
+        val = {};
+        found = false;
+    }
+    explicit operator bool() const {
+        return found;
+    }
+    // the value; valid until the guard is released.
+    std::string_view value() const {
+        return val;
+    }
+};
+
+#endif
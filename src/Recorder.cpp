@@ -25,6 +25,7 @@ using namespace std;
 Recorder::Recorder(int task_num){
 	this->task_num = task_num;
 	this->localFields = new std::map<std::string, std::string>[task_num];
+	this->latencies = new padded<LatencyHistogram>[task_num];
 }
 void Recorder::addGlobalField(std::string field){
 	if(globalFields.count(field)==0){
@@ -41,6 +42,17 @@ void Recorder::addThreadField(std::string field, std::string (*summarizeFunction
 	}
 }
 
+void Recorder::addLatencyFields(){
+	if(!latencyFields){
+		latencyFields = true;
+		ticksPerNs = LatencyHistogram::ticks_per_ns();
+		addGlobalField("latency_p50(ns)");
+		addGlobalField("latency_p99(ns)");
+		addGlobalField("latency_p999(ns)");
+		addGlobalField("latency_max(ns)");
+	}
+}
+
 void Recorder::reportGlobalInfo(std::string field, double value){
 	globalFields[field]=ftoa(value);
 }
@@ -80,6 +92,17 @@ void Recorder::summarize(){
 		
 		globalFields[field]=summarizeFunction(list);
 	}
+
+	if(latencyFields){
+		LatencyHistogram all;
+		for(int i = 0; i<task_num; i++){
+			all.merge(latencies[i].ui);
+		}
+		globalFields["latency_p50(ns)"]=std::to_string((uint64_t)(all.percentile(0.5)/ticksPerNs));
+		globalFields["latency_p99(ns)"]=std::to_string((uint64_t)(all.percentile(0.99)/ticksPerNs));
+		globalFields["latency_p999(ns)"]=std::to_string((uint64_t)(all.percentile(0.999)/ticksPerNs));
+		globalFields["latency_max(ns)"]=std::to_string((uint64_t)(all.max()/ticksPerNs));
+	}
 }
 
 std::string Recorder::getData(){
@@ -36,11 +36,18 @@ limitations under the License.
 #include <fstream>
 #include <iostream>
 #include "HarnessUtils.hpp"
+#include "ConcurrentPrimitives.hpp"
+#include "LatencyHistogram.hpp"
 
 class Recorder{
 
 private:
 	int task_num;
+	// per-thread op latencies, merged into the latency fields
+	// if addLatencyFields() was called.
+	padded<LatencyHistogram>* latencies;
+	bool latencyFields = false;
+	double ticksPerNs = 1.0;
 
 public:
 	// member vars
@@ -54,6 +61,8 @@ public:
 	Recorder(int task_num);
 	void addGlobalField(std::string field);
 	void addThreadField(std::string s, std::string (*summarizeFunction)(std::list<std::string>));
+	// adds p50/p99/p999/max op latency (ns) columns
+	void addLatencyFields();
 
 	void reportGlobalInfo(std::string field, double value);
 	void reportGlobalInfo(std::string field, int value);
@@ -74,6 +83,11 @@ public:
 	void reportThreadInfo(std::string field, uint64_t value, int tid);
 	void reportThreadInfo(std::string field, std::string value, int tid);
 
+	// histogram thread tid records its op latencies (in ticks) into
+	LatencyHistogram& latency(int tid){
+		return latencies[tid].ui;
+	}
+
 
 private:
 	void summarize();
@@ -30,6 +30,8 @@
 // #include "HOHHashTable.hpp"
 #include "HashTable.hpp"
 #include "MontageHashTable.hpp"
+#include "MontageSwissHashTable.hpp"
+#include "MontageBPlusTree.hpp"
 #include "UnbalancedTree.hpp"
 #include "SOFTHashTable.hpp"
 #include "NVMSOFTHashTable.hpp"
@@ -87,9 +89,11 @@
 #include "SetChurnTest.hpp"
 #include "MapTest.hpp"
 #include "MapChurnTest.hpp"
+#include "RangeScanTest.hpp"
 #include "SyncTest.hpp"
 #ifndef MNEMOSYNE
 #include "RecoverVerifyTest.hpp"
+#include "AtomicScopeTest.hpp"
 #include "GraphRecoveryTest.hpp"
 #include "TGraphConstructionTest.hpp"
 #include "ToyTest.hpp"
@@ -137,6 +141,9 @@ int main(int argc, char *argv[])
 	gtc.addRideableOption(new HashTableFactory<string,PLACE_DRAM>(), "TransientHashTable<DRAM>");
 	gtc.addRideableOption(new HashTableFactory<string,PLACE_NVM>(), "TransientHashTable<NVM>");
 	gtc.addRideableOption(new MontageHashTableFactory<string>(), "MontageHashTable");
+	gtc.addRideableOption(new MontageHashTableFactory<string>(true), "MontageResizableHashTable");
+	gtc.addRideableOption(new MontageSwissHashTableFactory<string>(), "MontageSwissHashTable");
+	gtc.addRideableOption(new MontageBPlusTreeFactory<string>(), "MontageBPlusTree");
 
 	gtc.addRideableOption(new PNatarajanTreeFactory(), "PNataTree");
 	gtc.addRideableOption(new MontageNatarajanTreeFactory<string>(), "MontageNataTree");
@@ -158,6 +165,8 @@ int main(int argc, char *argv[])
 
 	/* LF hash tables */
 	gtc.addRideableOption(new MontageLfHashTableFactory<uint64_t>(), "MontageLfHashTable<uint64_t>");
+	gtc.addRideableOption(new MontageSwissHashTableFactory<uint64_t>(), "MontageSwissHashTable<uint64_t>");
+	gtc.addRideableOption(new MontageBPlusTreeFactory<uint64_t>(), "MontageBPlusTree<uint64_t>");
 	gtc.addRideableOption(new LockfreeHashTableFactory<uint64_t>(), "LfHashTable<uint64_t>");
 	gtc.addRideableOption(new NVMLockfreeHashTableFactory<uint64_t>(), "NVMLockfreeHashTable<uint64_t>");
 
@@ -175,18 +184,26 @@ int main(int argc, char *argv[])
 	gtc.addTestOption(new MapChurnTest<string,string>(0, 0, 50, 50, 1000000, 500000), "MapChurnTest<string>:g0p0i50rm50:range=1000000:prefill=500000");
 	gtc.addTestOption(new MapChurnTest<string,string>(50, 0, 25, 25, 1000000, 500000), "MapChurnTest<string>:g50p0i25rm25:range=1000000:prefill=500000");
 	gtc.addTestOption(new MapChurnTest<string,string>(90, 0, 5, 5, 1000000, 500000), "MapChurnTest<string>:g90p0i5rm5:range=1000000:prefill=500000");
+	gtc.addTestOption(new MapChurnTest<string,string>(0, 0, 10, 90, 1000000, 1000000), "MapChurnTest<string>:g0p0i10rm90:range=1000000:prefill=1000000");
 	gtc.addTestOption(new MapTest<string,string>(0, 0, 50, 50, 1000000, 500000, 10000000), "MapTest<string>:g0p0i50rm50:range=1000000:prefill=500000:op=10000000");
 	gtc.addTestOption(new MapTest<string,string>(50, 0, 25, 25, 1000000, 500000, 10000000), "MapTest<string>:g50p0i25rm25:range=1000000:prefill=500000:op=10000000");
 	gtc.addTestOption(new MapTest<string,string>(90, 0, 5, 5, 1000000, 500000, 10000000), "MapTest<string>:g90p0i5rm5:range=1000000:prefill=500000:op=10000000");
+	gtc.addTestOption(new MapTest<string,string>(95, 0, 3, 2, 1000000, 500000, 10000000), "MapTest<string>:g95p0i3rm2:range=1000000:prefill=500000:op=10000000");
 	gtc.addTestOption(new MapSyncTest<string, string>(0, 0, 50, 50, 1000000, 500000), "MapSyncTest<string>:g0p0i50rm50:range=1000000:prefill=500000");
 	gtc.addTestOption(new MapSyncTest<string, string>(50, 0, 25, 25, 1000000, 500000), "MapSyncTest<string>:g50p0i25rm25:range=1000000:prefill=500000");
 	gtc.addTestOption(new QueueSyncTest(50,50,2000), "QueueSync:eq50dq50:prefill=2000");
 
 	
 	gtc.addTestOption(new MapChurnTest<uint64_t,uint64_t>(50, 0, 25, 25, 1000000, 500000), "MapChurnTest<uint64_t>:g50p0i25rm25:range=1000000:prefill=500000");
+	gtc.addTestOption(new MapChurnTest<uint64_t,uint64_t>(0, 0, 10, 90, 1000000, 1000000), "MapChurnTest<uint64_t>:g0p0i10rm90:range=1000000:prefill=1000000");
+	gtc.addTestOption(new MapChurnTest<string,string>(0, 0, 100, 0, 1000000, 0, true, 1024), "MapChurnTest<string>:growth:range=1000000:init=1024");
+	gtc.addTestOption(new MapChurnTest<uint64_t,uint64_t>(0, 0, 100, 0, 1000000, 0, true, 1024), "MapChurnTest<uint64_t>:growth:range=1000000:init=1024");
+	gtc.addTestOption(new RangeScanTest<string,string>(10, 80, 5, 5, 1000000, 500000), "RangeScanTest<string>:s10g80i5rm5:range=1000000:prefill=500000");
+	gtc.addTestOption(new RangeScanTest<uint64_t,uint64_t>(10, 80, 5, 5, 1000000, 500000), "RangeScanTest<uint64_t>:s10g80i5rm5:range=1000000:prefill=500000");
 	gtc.addTestOption(new MapVerify<string, string>(50, 0, 25, 25, 1000000, 10000), "MapVerify");
 #ifndef MNEMOSYNE
 	gtc.addTestOption(new RecoverVerifyTest<string,string>(&gtc), "RecoverVerifyTest");
+	gtc.addTestOption(new AtomicScopeTest<MontageHashTable<string,string>>(64), "AtomicScopeTest<MontageHashTable>:range=64");
 
 	gtc.addTestOption(new GraphTest(numVertices, meanEdgesPerVertex,vertexLoad,8000), "GraphTest:80edge20vertex:degree32");
 	gtc.addTestOption(new GraphTest(numVertices, meanEdgesPerVertex,vertexLoad,9980), "GraphTest:99.8edge.2vertex:degree32");
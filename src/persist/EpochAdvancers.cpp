@@ -5,24 +5,43 @@ using namespace pds;
 
 
 DedicatedEpochAdvancer::DedicatedEpochAdvancer(GlobalTestConfig* gtc, EpochSys* es):
-    gtc(gtc), esys(es){
-    if (gtc->checkEnv("EpochLength")){
-        epoch_length = stoi(gtc->getEnv("EpochLength"));
-    } else {
-        epoch_length = 100*1000;
-    }
+    gtc(gtc), esys(es), sync_cnt(0){
+    uint64_t unit = 1;
     if (gtc->checkEnv("EpochLengthUnit")){
         std::string env_unit = gtc->getEnv("EpochLengthUnit");
         if (env_unit == "Second"){
-            epoch_length *= 1000000;
+            unit = 1000000;
         } else if (env_unit == "Millisecond"){
-            epoch_length *= 1000;
+            unit = 1000;
         } else if (env_unit == "Microsecond"){
             // do nothing.
         } else {
             errexit("time unit not supported.");
         }
     }
+    if (gtc->checkEnv("EpochLength")){
+        epoch_length = stoi(gtc->getEnv("EpochLength")) * unit;
+    } else {
+        epoch_length = 100*1000 * unit;
+    }
+    if (gtc->checkEnv("AdaptiveEpoch") && epoch_length > 0){
+        adaptive = true;
+        durability_lag = 3 * epoch_length;
+        end_budget = epoch_length / 2;
+        min_length = 1000;
+        if (gtc->checkEnv("DurabilityLag")){
+            durability_lag = stoull(gtc->getEnv("DurabilityLag")) * unit;
+        }
+        if (gtc->checkEnv("EpochEndBudget")){
+            end_budget = stoull(gtc->getEnv("EpochEndBudget")) * unit;
+        }
+        if (gtc->checkEnv("MinEpochLength")){
+            min_length = stoull(gtc->getEnv("MinEpochLength")) * unit;
+        }
+        max_length = std::max(min_length, durability_lag / 2);
+        epoch_length = std::min(std::max(epoch_length, min_length), max_length);
+        esys->count_persist_volume();
+    }
     if (!gtc->checkEnv("NoAdvancerPinning")){
         find_first_socket();
     }
@@ -47,6 +66,9 @@ void DedicatedEpochAdvancer::advancer(int task_num){
     EpochSys::init_thread(task_num);// set tid to be the last
     uint64_t curr_epoch = INIT_EPOCH;
     int64_t next_sleep = epoch_length; // unsigned to signed, but should be fine.
+    auto last_advance = chrono::high_resolution_clock::now();
+    uint64_t last_volume = esys->get_persist_volume();
+    uint64_t last_syncs = 0;
     while(advancer_state.load() == INIT){}
     while(advancer_state.load() == RUNNING){
         if (next_sleep >= 0){
@@ -60,6 +82,27 @@ void DedicatedEpochAdvancer::advancer(int task_num){
                     ((double)abs(next_sleep))/epoch_length << "%" <<std::endl;
             }
         }
+
+        if (adaptive){
+            uint64_t now_epoch = esys->get_epoch();
+            if (now_epoch != curr_epoch){
+                // sync() has advanced the epoch since our last advance,
+                // so the current epoch is younger than it looks. Adapt
+                // to the interval anyway, so that steady sync() traffic
+                // still feeds the targets.
+                curr_epoch = now_epoch;
+                auto now = chrono::high_resolution_clock::now();
+                uint64_t volume = esys->get_persist_volume();
+                uint64_t syncs = sync_cnt.load();
+                adapt(0, volume - last_volume, syncs - last_syncs,
+                    chrono::duration_cast<chrono::microseconds>(now-last_advance).count());
+                last_advance = now;
+                last_volume = volume;
+                last_syncs = syncs;
+                next_sleep = epoch_length;
+                continue;
+            }
+        }
         
         auto wb_start = chrono::high_resolution_clock::now();
 
@@ -76,18 +119,73 @@ void DedicatedEpochAdvancer::advancer(int task_num){
         }
         
         // measure the time used for write-back and reclamation, and deduct it from epoch_length.
+        auto wb_end = chrono::high_resolution_clock::now();
         int64_t wb_length = chrono::duration_cast<chrono::microseconds>(
-            chrono::high_resolution_clock::now()-wb_start).count();
+            wb_end-wb_start).count();
+        if (adaptive){
+            uint64_t volume = esys->get_persist_volume();
+            uint64_t syncs = sync_cnt.load();
+            int64_t elapsed = chrono::duration_cast<chrono::microseconds>(
+                wb_end-last_advance).count();
+            adapt(wb_length, volume - last_volume, syncs - last_syncs, elapsed);
+            last_volume = volume;
+            last_syncs = syncs;
+            last_advance = wb_end;
+        }
         next_sleep = epoch_length - wb_length;
     }
+    if (adaptive && gtc->verbose){
+        std::cout<<"final adaptive epoch length:"<<epoch_length<<"us"<<std::endl;
+    }
     // std::cout<<"advancer_thread terminating..."<<std::endl;
 }
 
+// volume blocks were registered for write-back and sync() was called
+// syncs times in the elapsed us since the last advance, and writing
+// back the epoch before took wb_length us (0 if sync() advanced the
+// epoch instead). An update made in epoch e is durable once
+// on_epoch_end(e+1) returns, i.e. after about two epochs and a
+// write-back, so pick the longest epoch (fewer, larger write-backs)
+// that keeps both that and the write-back within their targets.
+// sync() writes back inline whatever we haven't yet, so also keep
+// epochs to half the mean gap between syncs: we then advance at
+// least twice per gap, and do most of that write-back off the
+// syncing threads.
+void DedicatedEpochAdvancer::adapt(int64_t wb_length, uint64_t volume, uint64_t syncs, int64_t elapsed){
+    const double alpha = 0.25; // weight of the newest sample
+    if (elapsed > 0){
+        write_rate = (1 - alpha) * write_rate + alpha * ((double)volume / elapsed);
+        sync_rate = (1 - alpha) * sync_rate + alpha * ((double)syncs / elapsed);
+    }
+    // write-back done by sync() isn't in wb_length, so don't let it
+    // skew the per-block cost.
+    if (volume > 0 && syncs == 0){
+        block_cost = (1 - alpha) * block_cost + alpha * ((double)wb_length / volume);
+    }
+    double wb_per_us = write_rate * block_cost; // write-back us per us of epoch
+    double target = (double)max_length;
+    if (wb_per_us > 0){
+        target = std::min(target, end_budget / wb_per_us);
+    }
+    target = std::min(target, durability_lag / (2 + wb_per_us));
+    if (sync_rate > 0){
+        target = std::min(target, 0.5 / sync_rate);
+    }
+    target = std::max(target, (double)min_length);
+    if (target < epoch_length){
+        // shrink at once to meet the targets; grow gradually.
+        epoch_length = target;
+    } else {
+        epoch_length += (target - epoch_length) * alpha;
+    }
+}
+
 uint64_t DedicatedEpochAdvancer::ongoing_target() {
     return target_epoch.ui.load();
 }
 
 void DedicatedEpochAdvancer::sync(uint64_t c){
+    sync_cnt.fetch_add(1, std::memory_order_relaxed);
     uint64_t curr_target = target_epoch.ui.load();
     while(curr_target < c+2){
         if (target_epoch.ui.compare_exchange_strong(curr_target, c+2)){
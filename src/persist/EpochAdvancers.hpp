@@ -38,6 +38,23 @@ class DedicatedEpochAdvancer : public EpochAdvancer{
     uint64_t epoch_length;
     hwloc_obj_t advancer_affinity = nullptr;
     paddedAtomic<uint64_t> target_epoch; // for helping from worker threads.
+
+    // adaptive mode (AdaptiveEpoch): after each advance, epoch_length
+    // is resized so that an update is durable within durability_lag
+    // and on_epoch_end takes no more than end_budget, from the
+    // observed write rate and write-back cost, and is kept to half the
+    // mean gap between sync() calls. All in us.
+    bool adaptive = false;
+    uint64_t durability_lag;
+    uint64_t end_budget;
+    uint64_t min_length;
+    uint64_t max_length;
+    double write_rate = 0; // registered blocks per us
+    double block_cost = 0; // write-back us per block
+    double sync_rate = 0; // sync() calls per us
+    std::atomic<uint64_t> sync_cnt;
+    void adapt(int64_t wb_length, uint64_t volume, uint64_t syncs, int64_t elapsed);
+
     void find_first_socket();
     void advancer(int task_num);
 public:
@@ -3,6 +3,7 @@
 
 #include <omp.h>
 #include <atomic>
+#include <algorithm>
 
 namespace pds{
 
@@ -60,6 +61,17 @@ namespace pds{
             gtc->setEnv("BufferSize", "64");
         }
 
+        if (gtc->checkEnv("CleanExit")){
+            string env_exit = gtc->getEnv("CleanExit");
+            if (env_exit == "Snapshot"){
+                snapshot_on_exit = true;
+            } else if (env_exit == "FullScan"){
+                snapshot_on_exit = false;
+            } else {
+                errexit("unrecognized 'CleanExit' environment");
+            }
+        }
+
         if (gtc->checkEnv("PersistStrat")){
             if (gtc->getEnv("PersistStrat") == "No"){
                 to_be_persisted = new NoToBePersistContainer();
@@ -155,6 +167,45 @@ namespace pds{
         // }
     }
 
+    void EpochSys::log_tombstone(const PBlk* blk, uint64_t c){
+        if (to_be_freed->frees_immediately()){
+            // the log would be gone before anyone could read it, as
+            // would the deleted payload.
+            return;
+        }
+        if (EpochSys::tid < 0 || EpochSys::tid >= task_num){
+            // no log for this thread; fall back to a DELETE anti-node.
+            new_anti_node(blk, c);
+            return;
+        }
+        TombstoneCursor& cur = tombstones[EpochSys::tid].ui;
+        if (cur.log == nullptr || cur.epoch != c ||
+            cur.cnt == TombstoneLog::CAPACITY){
+            // Open a new log for c. It's freed with the anti-nodes it
+            // replaces, an epoch after the payloads it deletes, so it
+            // can't be gone while it's still the current one of c.
+            TombstoneLog* log = new_pblk<TombstoneLog>();
+            log->epoch = c;
+            to_be_persisted->register_persist(log, c);
+            to_be_freed->register_free(log, c+1);
+            cur.log = log;
+            cur.epoch = c;
+            cur.cnt = 0;
+        }
+        uint64_t* slot = &cur.log->ids[cur.cnt++];
+        *slot = blk->id;
+        to_be_persisted->register_persist_range(cur.log, slot, sizeof(uint64_t), c);
+    }
+
+    void EpochSys::new_anti_node(const PBlk* blk, uint64_t c){
+        PBlk* del = new_pblk<PBlk>(*blk);
+        del->blktype = DELETE;
+        del->tid_sn = blk->tid_sn;
+        del->epoch = c;
+        to_be_persisted->register_persist(del, c);
+        to_be_freed->register_free(del, c+1);
+    }
+
     bool EpochSys::check_epoch(uint64_t c){
         return c == global_epoch->load(std::memory_order_seq_cst);
     }
@@ -205,6 +256,39 @@ namespace pds{
         epoch_advancer->on_end_transaction(this, c);
     }
 
+    void EpochSys::continue_transaction(uint64_t c){
+        local_descs[tid]->reinit();
+        local_descs[tid]->set_up_epoch(c);
+    }
+
+    uint64_t EpochSys::begin_held_transaction(){
+        std::atomic<uint64_t>& held = held_epochs[tid].ui;
+        assert(held.load() == NULL_EPOCH);
+        while (true){
+            uint64_t c = global_epoch->load(std::memory_order_seq_cst);
+            if (closing_epoch.ui.load(std::memory_order_seq_cst) >= c){
+                // an advance is already waiting to leave c.
+                continue;
+            }
+            held.store(c, std::memory_order_seq_cst);
+            // either the advance out of c sees our hold, or we see
+            // that it has begun and back off.
+            if (closing_epoch.ui.load(std::memory_order_seq_cst) < c &&
+                global_epoch->load(std::memory_order_seq_cst) == c){
+                break;
+            }
+            held.store(NULL_EPOCH, std::memory_order_seq_cst);
+        }
+        uint64_t ret = begin_transaction();
+        assert(ret == held.load());
+        return ret;
+    }
+
+    void EpochSys::end_held_transaction(uint64_t c){
+        end_transaction(c);
+        held_epochs[tid].ui.store(NULL_EPOCH, std::memory_order_seq_cst);
+    }
+
     uint64_t EpochSys::begin_reclaim_transaction(){
         uint64_t ret;
         do{
@@ -271,6 +355,14 @@ namespace pds{
         to_be_persisted->register_persist(b, c);
     }
 
+    void EpochSys::register_update_pblk_range(PBlk* b, void* start, size_t sz, uint64_t c){
+        if (c == NULL_EPOCH){
+            return;
+        }
+        assert(b->epoch == c);
+        to_be_persisted->register_persist_range(b, start, sz, c);
+    }
+
     void EpochSys::prepare_retire_pblk(PBlk* b, const uint64_t& c, std::vector<std::pair<PBlk*,PBlk*>>& pending_retires){
         pending_retires.emplace_back(b, nullptr);
     }
@@ -403,9 +495,17 @@ namespace pds{
             persisted_epochs->after_persist_epoch(c-1, curr_thread);
             curr_thread = persisted_epochs->next_thread_to_persist(c-1, curr_thread);
         }
+
+        // keep c until held transactions in it end.
+        uint64_t closing = closing_epoch.ui.load(std::memory_order_seq_cst);
+        while (closing < c &&
+            !closing_epoch.ui.compare_exchange_weak(closing, c, std::memory_order_seq_cst)){}
+        for (int i = 0; i < task_num; i++){
+            while (held_epochs[i].ui.load(std::memory_order_seq_cst) == c){}
+        }
     }
 
-    std::unordered_map<uint64_t, PBlk*>* EpochSys::recover(const int rec_thd){
+    std::unordered_map<uint64_t, PBlk*>* EpochSys::recover(const int rec_thd, const RecoverCallback* stream){
         std::unordered_map<uint64_t, PBlk*>* in_use = new std::unordered_map<uint64_t, PBlk*>();
         uint64_t max_epoch = 0;
 #ifndef MNEMOSYNE
@@ -418,19 +518,40 @@ namespace pds{
             clean_start = false;
             std::cout<<"dirty restart"<<std::endl;
             // dirty restart, epoch system and app need to handle
+            unlink_snapshot();
         } else {
             std::cout<<"clean restart"<<std::endl;
             clean_start = true;
             // clean restart, epoch system and app may still need iter to do something
+            if (load_snapshot(in_use, stream, rec_thd)){
+                sys_mode = ONLINE;
+                if (stream){
+                    delete in_use;
+                    in_use = nullptr;
+                }
+                return in_use;
+            }
         }
 
-        std::atomic<int> curr_reporting;
-        curr_reporting = 0;
         pthread_barrier_t sync_point;
         pthread_barrier_init(&sync_point, NULL, rec_thd);
         std::vector<std::thread> workers;
-        
-        std::unordered_set<uint64_t> deleted_ids;
+
+        // Merges are partitioned on id hash: recovery thread t owns
+        // ids with id%rec_thd==t, and the others send it their
+        // entries through outboxes, so no merge is serialized.
+        std::vector<padded<uint64_t>> max_epochs(rec_thd);
+        std::vector<std::vector<std::vector<uint64_t>>> deleted_outboxes(
+            rec_thd, std::vector<std::vector<uint64_t>>(rec_thd));
+        std::vector<std::unordered_set<uint64_t>> deleted_ids(rec_thd);
+        std::vector<RecoverOutbox> outboxes(rec_thd, RecoverOutbox(rec_thd));
+        std::vector<padded<uint64_t>> stream_cnts(rec_thd);
+        // without stream, surviving pblks are collected per shard and
+        // put in in_use at the end.
+        std::vector<std::vector<PBlk*>> in_use_shards(rec_thd);
+        RecoverCallback collect = [&](PBlk* blk, int t){
+            in_use_shards[t].push_back(blk);
+        };
         auto begin = chrono::high_resolution_clock::now();
         auto end = begin;
         for (int rec_tid = 0; rec_tid < rec_thd; rec_tid++) {
@@ -439,6 +560,7 @@ namespace pds{
                 thread_local uint64_t max_epoch_local = 0;
                 thread_local std::unordered_multimap<uint64_t, PBlk*> anti_nodes_local;
                 thread_local std::unordered_set<uint64_t> deleted_ids_local;
+                thread_local std::vector<TombstoneLog*> tombstones_local;
                 // make the first whole pass thorugh all blocks, find the epoch block
                 // and help Ralloc fully recover by completing the pass.
                 for (; !itr_raw[rec_tid].is_last(); ++itr_raw[rec_tid]){
@@ -455,16 +577,22 @@ namespace pds{
                         if (curr_blk->get_epoch() != NULL_EPOCH) {
                             deleted_ids_local.insert(curr_blk->get_id());
                         }
+                    } else if (curr_blk->blktype == TOMBSTONE){
+                        if (clean_start) {
+                            errexit("tombstone log appears after a clean exit.");
+                        }
+                        // read once the premature epochs are known
+                        tombstones_local.push_back((TombstoneLog*)curr_blk);
                     }
                     max_epoch_local = std::max(max_epoch_local, curr_blk->get_epoch());
                 }
                 // report after the first pass:
                 // calculate the maximum epoch number as the current epoch.
+                max_epochs[rec_tid].ui = max_epoch_local;
                 pthread_barrier_wait(&sync_point);
                 if (!epoch_container){
                     errexit("epoch container not found during recovery");
                 }
-                while(curr_reporting.load() != rec_tid);
                 if (rec_tid == 0) {
                     end = chrono::high_resolution_clock::now();
                     auto dur = end - begin;
@@ -475,44 +603,61 @@ namespace pds{
                               << "ms in first pass" << std::endl;
                     begin = chrono::high_resolution_clock::now();
                 }
-                max_epoch = std::max(max_epoch, max_epoch_local);
-                if (rec_tid == rec_thd-1){
-                    end = chrono::high_resolution_clock::now();
-                    auto dur = end - begin;
-                    std::cout << "Spent " << std::chrono::duration_cast<std::chrono::milliseconds>(dur).count()
-                              << "ms in first merge"
-                              << std::endl;
-                    begin = chrono::high_resolution_clock::now();
+                uint64_t curr_max_epoch = 0;
+                for (auto& e : max_epochs){
+                    curr_max_epoch = std::max(curr_max_epoch, e.ui);
                 }
-                curr_reporting.store((rec_tid+1) % rec_thd);
-                
-                pthread_barrier_wait(&sync_point);
-                // remove premature deleted_ids, and merge deleted_ids.
-                for (uint64_t e : std::vector<uint64_t>{max_epoch, max_epoch-1}){
+                if (rec_tid == 0){
+                    max_epoch = curr_max_epoch;
+                }
+
+                // remove premature deleted_ids, and send deleted_ids
+                // to their owners.
+                for (uint64_t e : std::vector<uint64_t>{curr_max_epoch, curr_max_epoch-1}){
                     auto immature = anti_nodes_local.equal_range(e);
                     for (auto itr = immature.first; itr != immature.second; itr++){
                         deleted_ids_local.erase(itr->second->get_id());
                     }
                 }
-                // merge the results of deleted_ids_local
+                for (TombstoneLog* log : tombstones_local){
+                    uint64_t e = log->get_epoch();
+                    if (e == NULL_EPOCH || e + 2 > curr_max_epoch){
+                        continue;
+                    }
+                    for (int i = 0; i < TombstoneLog::CAPACITY &&
+                        log->ids[i] != TombstoneLog::EMPTY; i++){
+                        deleted_outboxes[rec_tid][log->ids[i] % rec_thd].push_back(log->ids[i]);
+                    }
+                }
+                for (uint64_t id : deleted_ids_local){
+                    deleted_outboxes[rec_tid][id % rec_thd].push_back(id);
+                }
+                deleted_ids_local.clear();
                 pthread_barrier_wait(&sync_point);
-                while (curr_reporting.load() != rec_tid);
-                deleted_ids.merge(deleted_ids_local);
-                curr_reporting.store((rec_tid + 1) % rec_thd);
+                for (auto& outbox : deleted_outboxes){
+                    deleted_ids[rec_tid].insert(outbox[rec_tid].begin(), outbox[rec_tid].end());
+                    std::vector<uint64_t>().swap(outbox[rec_tid]);
+                }
 
                 // make a second pass through all pblks
                 pthread_barrier_wait(&sync_point);
                 if (rec_tid == 0){
+                    end = chrono::high_resolution_clock::now();
+                    auto dur = end - begin;
+                    std::cout << "Spent " << std::chrono::duration_cast<std::chrono::milliseconds>(dur).count()
+                              << "ms in first merge"
+                              << std::endl;
+                    begin = chrono::high_resolution_clock::now();
                     itr_raw = _ral->recover(rec_thd);
                 }
                 pthread_barrier_wait(&sync_point);
-                uint64_t epoch_cap = max_epoch - 2;
+                uint64_t epoch_cap = curr_max_epoch - 2;
                 thread_local std::vector<PBlk*> not_in_use_local;
-                thread_local std::unordered_map<uint64_t, PBlk*> in_use_local;
                 thread_local int second_pass_blks = 0;
                 for (; !itr_raw[rec_tid].is_last(); ++itr_raw[rec_tid]) {
                     second_pass_blks++;
                     PBlk* curr_blk = (PBlk*)*itr_raw[rec_tid];
+                    uint64_t curr_id = curr_blk->get_id();
                     // put all premature pblks and those marked by
                     // deleted_ids in not_in_use
                     if (// skip epoch container
@@ -520,58 +665,34 @@ namespace pds{
                         // leave DESC blocks untouched for now.
                         curr_blk->blktype != DESC &&
                         // DELETE blocks are already put into anti_nodes_local.
-                        curr_blk->blktype != DELETE && (
+                        curr_blk->blktype != DELETE &&
+                        // and tombstone logs into tombstones_local.
+                        curr_blk->blktype != TOMBSTONE && (
                             // block without epoch number, probably just inited
                             curr_blk->epoch == NULL_EPOCH || 
                             // premature pblk
                             curr_blk->epoch > epoch_cap || 
                             // marked deleted by some anti-block
-                            deleted_ids.find(curr_blk->get_id()) != deleted_ids.end() 
+                            deleted_ids[curr_id % rec_thd].count(curr_id) != 0
                         )) {
                         assert(curr_blk->get_blktype() != EPOCH);
                         not_in_use_local.push_back(curr_blk);
                     } else {
-                        // put all others in in_use while resolve conflict
+                        // send all others to the owner of their id
+                        // shard, who resolves conflict
                         switch (curr_blk->blktype) {
                             case OWNED:
                                 errexit(
                                     "OWNED isn't a valid blktype in this "
                                     "version.");
                                 break;
-                            case ALLOC: {
-                                auto insert_res =
-                                    in_use_local.insert({curr_blk->id, curr_blk});
-                                if (insert_res.second == false) {
-                                    if (clean_start) {
-                                        errexit(
-                                            "more than one record with the "
-                                            "same id after a clean exit.");
-                                    }
-                                    not_in_use_local.push_back(curr_blk);
-                                }
-                            } break;
-                            case UPDATE: {
-                                auto search = in_use_local.find(curr_blk->id);
-                                if (search != in_use_local.end()) {
-                                    if (clean_start) {
-                                        errexit(
-                                            "more than one record with the "
-                                            "same id after a clean exit.");
-                                    }
-                                    if (curr_blk->epoch >
-                                        search->second->epoch) {
-                                        not_in_use_local.push_back(search->second);
-                                        search->second =
-                                            curr_blk;  // TODO: double-check if
-                                                       // this is right.
-                                    } else {
-                                        not_in_use_local.push_back(curr_blk);
-                                    }
-                                } else {
-                                    in_use_local.insert({curr_blk->id, curr_blk});
-                                }
-                            } break;
+                            case ALLOC:
+                            case UPDATE:
+                                outboxes[rec_tid][curr_id % rec_thd].emplace_back(
+                                    curr_id, curr_blk);
+                                break;
                             case DELETE:
+                            case TOMBSTONE:
                             case EPOCH:
                                 break;
                             case DESC:
@@ -583,9 +704,8 @@ namespace pds{
                         }
                     }
                 }
-                // merge the results of in_use, resolve conflict
+                // resolve conflict within the shard we own
                 pthread_barrier_wait(&sync_point);
-                while (curr_reporting.load() != rec_tid);
                 if (rec_tid == 0) {
                     end = chrono::high_resolution_clock::now();
                     auto dur = end - begin;
@@ -596,20 +716,14 @@ namespace pds{
                               << "ms in second pass" << std::endl;
                     begin = chrono::high_resolution_clock::now();
                 }
-                std::cout<<"second pass blk count:"<<second_pass_blks<<std::endl;
-                for (auto itr : in_use_local) {
-                    auto found = in_use->find(itr.first);
-                    if (found == in_use->end()) {
-                        in_use->insert({itr.first, itr.second});
-                    } else if (found->second->get_epoch() <
-                               itr.second->get_epoch()) {
-                        not_in_use_local.push_back(found->second);
-                        found->second = itr.second;
-                    } else {
-                        not_in_use_local.push_back(itr.second);
-                    }
+                if (gtc->verbose){
+                    std::cout<<"second pass blk count:"<<second_pass_blks<<std::endl;
                 }
-                if (rec_tid == rec_thd - 1) {
+                EpochSys::init_thread(rec_tid);
+                stream_cnts[rec_tid].ui = stream_shard(outboxes, rec_tid,
+                    clean_start, stream ? *stream : collect, not_in_use_local);
+                pthread_barrier_wait(&sync_point);
+                if (rec_tid == 0) {
                     end = chrono::high_resolution_clock::now();
                     auto dur = end - begin;
                     std::cout << "Spent "
@@ -619,7 +733,6 @@ namespace pds{
                               << "ms in second merge" << std::endl;
                     begin = chrono::high_resolution_clock::now();
                 }
-                curr_reporting.store((rec_tid + 1) % rec_thd);
                 // clean up not_in_use and anti-nodes
                 for (auto itr : not_in_use_local) {
                     itr->set_epoch(NULL_EPOCH);
@@ -629,6 +742,11 @@ namespace pds{
                     itr.second->set_epoch(NULL_EPOCH);
                     _ral->deallocate(itr.second, rec_tid);
                 }
+                for (TombstoneLog* log : tombstones_local) {
+                    log->set_epoch(NULL_EPOCH);
+                    _ral->deallocate(log, rec_tid);
+                }
+                tombstones_local.clear();
                 pthread_barrier_wait(&sync_point);
                 if (rec_tid == rec_thd - 1) {
                     end = chrono::high_resolution_clock::now();
@@ -648,6 +766,27 @@ namespace pds{
             }
         }
         global_epoch->store(max_epoch);
+        if (stream){
+            for (auto& cnt : stream_cnts){
+                recovered_cnt += cnt.ui;
+            }
+            delete in_use;
+            in_use = nullptr;
+        } else {
+            // conflicts are already resolved in the shards, so this is
+            // a plain fill. Streaming recovery skips it.
+            size_t total = 0;
+            for (auto& shard : in_use_shards){
+                total += shard.size();
+            }
+            in_use->reserve(total);
+            for (auto& shard : in_use_shards){
+                for (PBlk* blk : shard){
+                    in_use->insert({blk->get_id(), blk});
+                }
+            }
+            recovered_cnt = in_use->size();
+        }
         // set system mode back to online
         sys_mode = ONLINE;
 
@@ -658,6 +797,182 @@ namespace pds{
         return in_use;
     }
 
+    void EpochSys::write_snapshot(std::vector<PBlk*>& live){
+        if (!snapshot_on_exit){
+            return;
+        }
+        // make every finished operation durable, and then release
+        // whatever is still waiting to be freed, so that no block
+        // outside of the snapshot survives this exit.
+        epoch_advancer->sync(get_epoch());
+        epoch_advancer->sync(get_epoch());
+        to_be_freed->free_all([this](PBlk*& b){
+            b->~PBlk();
+            clear_epoch(b);
+            _ral->deallocate(b);
+            persist_func::clwb(b);
+        });
+        persist_func::sfence();
+
+        // sort payloads by address so that the restart walks them
+        // sequentially.
+        std::sort(live.begin(), live.end());
+        size_t sz = Snapshot::size_of(task_num, live.size());
+        Snapshot* snapshot = (Snapshot*)_ral->allocate(sz);
+        new (snapshot) Snapshot(task_num, live.size());
+        snapshot->epoch_container = epoch_container;
+        for (int i = 0; i < task_num; i++){
+            snapshot->descs()[i] = local_descs[i];
+        }
+        pptr<PBlk>* pblks = snapshot->pblks();
+        for (size_t i = 0; i < live.size(); i++){
+            pblks[i] = live[i];
+        }
+        persist_func::clwb_range_nofence(snapshot, sz);
+        persist_func::sfence();
+        // linking the snapshot to the root commits it.
+        _ral->set_root(snapshot, SNAPSHOT_ROOT);
+        snapshot_written = true;
+        std::cout<<"snapshot of "<<live.size()<<" PBlks written."<<std::endl;
+    }
+
+    bool EpochSys::load_snapshot(std::unordered_map<uint64_t, PBlk*>* in_use,
+        const RecoverCallback* stream, const int rec_thd){
+        Snapshot* snapshot = _ral->get_root<Snapshot>(SNAPSHOT_ROOT);
+        if (snapshot == nullptr){
+            return false;
+        }
+        if (snapshot->blktype != SNAPSHOT){
+            errexit("snapshot root doesn't point to a snapshot");
+        }
+        epoch_container = snapshot->epoch_container;
+        if (!epoch_container){
+            errexit("epoch container not found in snapshot");
+        }
+        global_epoch = &epoch_container->global_epoch;
+        for (uint64_t i = 0; i < snapshot->desc_cnt; i++){
+            sc_desc_t* desc = snapshot->descs()[i];
+            restore_desc(desc);
+        }
+        pptr<PBlk>* pblks = snapshot->pblks();
+        uint64_t pblk_cnt = snapshot->pblk_cnt;
+        if (stream){
+            // each thread streams a contiguous slice of the table.
+            std::vector<std::thread> workers;
+            for (int rec_tid = 0; rec_tid < rec_thd; rec_tid++) {
+                workers.emplace_back(std::thread([&, rec_tid]() {
+                    hwloc_set_cpubind(gtc->topology, gtc->affinities[rec_tid]->cpuset, HWLOC_CPUBIND_THREAD);
+                    EpochSys::init_thread(rec_tid);
+                    uint64_t slice_end = pblk_cnt*(rec_tid+1)/rec_thd;
+                    for (uint64_t i = pblk_cnt*rec_tid/rec_thd; i < slice_end; i++){
+                        (*stream)(pblks[i], rec_tid);
+                    }
+                }));
+            }
+            for (auto& worker : workers) {
+                if (worker.joinable()) {
+                    worker.join();
+                }
+            }
+        } else {
+            in_use->reserve(pblk_cnt);
+            for (uint64_t i = 0; i < pblk_cnt; i++){
+                PBlk* blk = pblks[i];
+                in_use->insert({blk->get_id(), blk});
+            }
+        }
+        recovered_cnt = pblk_cnt;
+        std::cout<<"restored "<<pblk_cnt<<" PBlks from snapshot."<<std::endl;
+        // the snapshot is only valid for this restart; a crash from
+        // now on must go through the full recovery.
+        unlink_snapshot();
+        _ral->deallocate(snapshot);
+        return true;
+    }
+
+    uint64_t EpochSys::stream_shard(std::vector<RecoverOutbox>& outboxes, const int rec_tid,
+        bool clean_start, const RecoverCallback& stream, std::vector<PBlk*>& not_in_use){
+        std::vector<std::pair<uint64_t, PBlk*>> shard;
+        size_t shard_size = 0;
+        for (auto& outbox : outboxes){
+            shard_size += outbox[rec_tid].size();
+        }
+        shard.reserve(shard_size);
+        for (auto& outbox : outboxes){
+            shard.insert(shard.end(), outbox[rec_tid].begin(), outbox[rec_tid].end());
+            std::vector<std::pair<uint64_t, PBlk*>>().swap(outbox[rec_tid]);
+        }
+        // sort by id, newer epoch first among the same id.
+        std::sort(shard.begin(), shard.end(),
+            [](const std::pair<uint64_t, PBlk*>& a, const std::pair<uint64_t, PBlk*>& b){
+                if (a.first != b.first){
+                    return a.first < b.first;
+                }
+                return a.second->get_epoch() > b.second->get_epoch();
+            });
+        uint64_t cnt = 0;
+        for (size_t i = 0; i < shard.size(); i++){
+            if (i > 0 && shard[i].first == shard[i-1].first){
+                if (clean_start) {
+                    errexit("more than one record with the same id after a clean exit.");
+                }
+                not_in_use.push_back(shard[i].second);
+            } else {
+                stream(shard[i].second, rec_tid);
+                cnt++;
+            }
+        }
+        return cnt;
+    }
+
+    uint32_t EpochSys::get_root_tag(const std::string& name){
+        if (name.empty() || name.size() >= Epoch::ROOT_NAME_LEN){
+            errexit("root name must be 1 to 31 characters long.");
+        }
+        int free_slot = -1;
+        for (int i = 0; i < Epoch::NAMED_ROOTS; i++){
+            char* slot = epoch_container->root_names[i];
+            if (slot[0] == '\0'){
+                if (free_slot == -1){
+                    free_slot = i;
+                }
+            } else if (strncmp(slot, name.c_str(), Epoch::ROOT_NAME_LEN) == 0){
+                return i + 1;
+            }
+        }
+        if (free_slot == -1){
+            errexit("out of named roots.");
+        }
+        // the name must be durable before any payload tagged with it.
+        char* slot = epoch_container->root_names[free_slot];
+        strcpy(slot, name.c_str());
+        persist_func::clwb_range_nofence(slot, Epoch::ROOT_NAME_LEN);
+        persist_func::sfence();
+        return free_slot + 1;
+    }
+
+    void EpochSys::unlink_snapshot(){
+        if (_ral->get_root<Snapshot>(SNAPSHOT_ROOT) != nullptr){
+            _ral->set_root(nullptr, SNAPSHOT_ROOT);
+        }
+    }
+
+    void EpochSys::restore_desc(sc_desc_t* desc){
+        // blocking EpochSys allocates fresh descriptors in init().
+        desc->epoch = NULL_EPOCH;
+        _ral->deallocate(desc);
+    }
+
+    void nbEpochSys::restore_desc(sc_desc_t* desc){
+        // reuse descriptors of threads that still exist, just as
+        // recover() does.
+        uint64_t desc_tid = desc->get_tid();
+        if (desc_tid < (uint64_t)task_num){
+            assert(local_descs[desc_tid] == nullptr);
+            local_descs[desc_tid] = desc;
+        }
+    }
+
     void nbEpochSys::register_alloc_pblk(PBlk* b, uint64_t c){
         // static_assert(std::is_convertible<T*, PBlk*>::value,
         //     "T must inherit PBlk as public");
@@ -824,6 +1139,13 @@ namespace pds{
         epoch_advancer->on_end_transaction(this, c);
     }
 
+    void nbEpochSys::continue_transaction(uint64_t c){
+        // local_persist and local_free already ran when c was begun.
+        local_descs[tid]->reinit();
+        local_descs[tid]->set_up_epoch(c);
+        to_be_persisted->register_persist_desc_local(c, EpochSys::tid);
+    }
+
     uint64_t nbEpochSys::begin_reclaim_transaction(){
         uint64_t ret;
         ret = global_epoch->load(std::memory_order_seq_cst);
@@ -866,9 +1188,9 @@ namespace pds{
         // persist_func::sfence();
     }
 
-    std::unordered_map<uint64_t, PBlk*>* nbEpochSys::recover(const int rec_thd) {
+    std::unordered_map<uint64_t, PBlk*>* nbEpochSys::recover(const int rec_thd, const RecoverCallback* stream) {
         std::unordered_map<uint64_t, PBlk*>* in_use = new std::unordered_map<uint64_t, PBlk*>();
-        std::unordered_map<uint64_t, sc_desc_t*> descs;  //tid->desc
+        std::vector<sc_desc_t*> descs;  //tid->desc
         uint64_t max_tid = 0;
         uint64_t max_epoch = 0;
 #ifndef MNEMOSYNE
@@ -881,19 +1203,48 @@ namespace pds{
             clean_start = false;
             std::cout << "dirty restart" << std::endl;
             // dirty restart, epoch system and app need to handle
+            unlink_snapshot();
         } else {
             std::cout << "clean restart" << std::endl;
             clean_start = true;
             // clean restart, epoch system and app may still need iter to do something
+            if (load_snapshot(in_use, stream, rec_thd)) {
+                sys_mode = ONLINE;
+                if (stream) {
+                    delete in_use;
+                    in_use = nullptr;
+                }
+                return in_use;
+            }
         }
 
-        std::atomic<int> curr_reporting;
-        curr_reporting = 0;
         pthread_barrier_t sync_point;
         pthread_barrier_init(&sync_point, NULL, rec_thd);
         std::vector<std::thread> workers;
 
-        std::unordered_set<uint64_t> deleted_ids;
+        // Merges are partitioned on id hash: recovery thread t owns
+        // ids with id%rec_thd==t, and the others send it their
+        // entries through outboxes, so no merge is serialized.
+        std::vector<padded<uint64_t>> max_epochs(rec_thd);
+        std::vector<std::vector<sc_desc_t*>> descs_found(rec_thd);
+        std::vector<std::vector<std::vector<uint64_t>>> deleted_outboxes(
+            rec_thd, std::vector<std::vector<uint64_t>>(rec_thd));
+        std::vector<std::unordered_set<uint64_t>> deleted_ids(rec_thd);
+        std::vector<RecoverOutbox> outboxes(rec_thd, RecoverOutbox(rec_thd));
+        std::vector<padded<uint64_t>> stream_cnts(rec_thd);
+        // without stream, surviving pblks are collected per shard and
+        // put in in_use at the end.
+        std::vector<std::vector<PBlk*>> in_use_shards(rec_thd);
+        RecoverCallback collect = [&](PBlk* blk, int t) {
+            in_use_shards[t].push_back(blk);
+        };
+        // descs is read-only once built, so lookups need no lock.
+        auto desc_of = [&](uint64_t curr_tid) {
+            if (curr_tid >= descs.size() || descs[curr_tid] == nullptr) {
+                errexit("descriptor not found during recovery");
+            }
+            return descs[curr_tid];
+        };
 
         for (int rec_tid = 0; rec_tid < rec_thd; rec_tid++) {
             workers.emplace_back(std::thread([&, rec_tid]() {
@@ -901,10 +1252,8 @@ namespace pds{
                                   gtc->affinities[rec_tid]->cpuset,
                                   HWLOC_CPUBIND_THREAD);
                 thread_local uint64_t max_epoch_local = 0;
-                thread_local uint64_t max_tid_local = -1;
                 thread_local std::vector<PBlk*> anti_nodes_local;
                 thread_local std::unordered_set<uint64_t> deleted_ids_local;
-                thread_local std::unordered_map<uint64_t, sc_desc_t*> descs_local;
                 // make the first whole pass thorugh all blocks, find the epoch block
                 // and help Ralloc fully recover by completing the pass.
                 for (; !itr_raw[rec_tid].is_last(); ++itr_raw[rec_tid]) {
@@ -920,8 +1269,7 @@ namespace pds{
                         auto* tmp = reinterpret_cast<sc_desc_t*>(curr_blk);
                         assert(tmp != nullptr);
                         uint64_t curr_tid = tmp->get_tid();
-                        max_tid_local = std::max(max_tid_local, curr_tid);
-                        descs_local[curr_tid] = tmp;
+                        descs_found[rec_tid].push_back(tmp);
                         if(curr_tid<(uint64_t)task_num) {
                             assert(local_descs[curr_tid]==nullptr);
                             local_descs[curr_tid] = tmp;
@@ -936,29 +1284,33 @@ namespace pds{
                 }
                 // report after the first pass:
                 // calculate the maximum epoch number as the current epoch.
-                // calculate the maximum tid
-                // merge descs
+                max_epochs[rec_tid].ui = max_epoch_local;
                 pthread_barrier_wait(&sync_point);
                 if (!epoch_container) {
                     errexit("epoch container not found during recovery");
                 }
-                while (curr_reporting.load() != rec_tid)
-                    ;
-                max_epoch = std::max(max_epoch, max_epoch_local);
-                max_tid = std::max(max_tid, max_tid_local);
-                descs.merge(descs_local);
-                if (rec_tid == rec_thd - 1) {
-                    // some sanity check
-                    // in data structures with background threads,
-                    // these don't always hold
-                    // assert(descs.size() == max_tid + 1);
-                    // for (uint64_t i = 0; i < max_tid; i++) {
-                    //     assert(descs.find(i) != descs.end());
-                    // }
+                uint64_t curr_max_epoch = 0;
+                for (auto& e : max_epochs) {
+                    curr_max_epoch = std::max(curr_max_epoch, e.ui);
+                }
+                if (rec_tid == 0) {
+                    max_epoch = curr_max_epoch;
+                    // index descs by tid. in data structures with
+                    // background threads, tids may have holes.
+                    for (auto& found : descs_found) {
+                        for (auto* d : found) {
+                            max_tid = std::max(max_tid, d->get_tid());
+                        }
+                    }
+                    descs.assign(max_tid + 1, nullptr);
+                    for (auto& found : descs_found) {
+                        for (auto* d : found) {
+                            descs[d->get_tid()] = d;
+                        }
+                    }
                 }
-                curr_reporting.store((rec_tid + 1) % rec_thd);
 
-                uint64_t epoch_cap = max_epoch - 2;
+                uint64_t epoch_cap = curr_max_epoch - 2;
                 pthread_barrier_wait(&sync_point);
                 // remove premature deleted_ids
                 for (auto n : anti_nodes_local){
@@ -967,18 +1319,22 @@ namespace pds{
                     if ( // anti node belongs to an epoch too new
                         n->get_epoch() > epoch_cap ||
                         // transaction is not registered
-                        curr_sn > descs[curr_tid]->get_sn() ||
+                        curr_sn > desc_of(curr_tid)->get_sn() ||
                         // transaction registered but not committed
-                        (curr_sn == descs[curr_tid]->get_sn() && !descs[curr_tid]->committed())){
+                        (curr_sn == desc_of(curr_tid)->get_sn() && !desc_of(curr_tid)->committed())){
                         deleted_ids_local.erase(n->get_id());
                     }
                 }
-                // merge the results of deleted_ids_local
+                // send deleted_ids to their owners
+                for (uint64_t id : deleted_ids_local) {
+                    deleted_outboxes[rec_tid][id % rec_thd].push_back(id);
+                }
+                deleted_ids_local.clear();
                 pthread_barrier_wait(&sync_point);
-                while (curr_reporting.load() != rec_tid)
-                    ;
-                deleted_ids.merge(deleted_ids_local);
-                curr_reporting.store((rec_tid + 1) % rec_thd);
+                for (auto& outbox : deleted_outboxes) {
+                    deleted_ids[rec_tid].insert(outbox[rec_tid].begin(), outbox[rec_tid].end());
+                    std::vector<uint64_t>().swap(outbox[rec_tid]);
+                }
 
                 // make a second pass through all pblks
                 pthread_barrier_wait(&sync_point);
@@ -988,11 +1344,11 @@ namespace pds{
                 pthread_barrier_wait(&sync_point);
                 
                 thread_local std::vector<PBlk*> not_in_use_local;
-                thread_local std::unordered_map<uint64_t, PBlk*> in_use_local;
                 for (; !itr_raw[rec_tid].is_last(); ++itr_raw[rec_tid]) {
                     PBlk* curr_blk = (PBlk*)*itr_raw[rec_tid];
                     auto curr_tid = curr_blk->get_tid();
                     auto curr_sn = curr_blk->get_sn();
+                    uint64_t curr_id = curr_blk->get_id();
                     // put all premature pblks and those marked by
                     // deleted_ids in not_in_use
                     if ( // skip epoch container
@@ -1006,53 +1362,26 @@ namespace pds{
                             // premature pblk
                             curr_blk->epoch > epoch_cap ||
                             // marked deleted by some anti-block
-                            deleted_ids.find(curr_blk->get_id()) != deleted_ids.end() ||
+                            deleted_ids[curr_id % rec_thd].count(curr_id) != 0 ||
                             // premature transaction: not registered in descs
-                            curr_sn > descs[curr_tid]->get_sn() ||
+                            curr_sn > desc_of(curr_tid)->get_sn() ||
                             // premature transaction: registered but not committed
-                            (curr_sn == descs[curr_tid]->get_sn() && !descs[curr_tid]->committed()))) {
+                            (curr_sn == desc_of(curr_tid)->get_sn() && !desc_of(curr_tid)->committed()))) {
                         not_in_use_local.push_back(curr_blk);
                     } else {
-                        // put all others in in_use while resolve conflict
+                        // send all others to the owner of their id
+                        // shard, who resolves conflict
                         switch (curr_blk->blktype) {
                             case OWNED:
                                 errexit(
                                     "OWNED isn't a valid blktype in this "
                                     "version.");
                                 break;
-                            case ALLOC: {
-                                auto insert_res =
-                                    in_use_local.insert({curr_blk->id, curr_blk});
-                                if (insert_res.second == false) {
-                                    if (clean_start) {
-                                        errexit(
-                                            "more than one record with the "
-                                            "same id after a clean exit.");
-                                    }
-                                    not_in_use_local.push_back(curr_blk);
-                                }
-                            } break;
-                            case UPDATE: {
-                                auto search = in_use_local.find(curr_blk->id);
-                                if (search != in_use_local.end()) {
-                                    if (clean_start) {
-                                        errexit(
-                                            "more than one record with the "
-                                            "same id after a clean exit.");
-                                    }
-                                    if (curr_blk->epoch >
-                                        search->second->epoch) {
-                                        not_in_use_local.push_back(search->second);
-                                        search->second =
-                                            curr_blk;  // TODO: double-check if
-                                                       // this is right.
-                                    } else {
-                                        not_in_use_local.push_back(curr_blk);
-                                    }
-                                } else {
-                                    in_use_local.insert({curr_blk->id, curr_blk});
-                                }
-                            } break;
+                            case ALLOC:
+                            case UPDATE:
+                                outboxes[rec_tid][curr_id % rec_thd].emplace_back(
+                                    curr_id, curr_blk);
+                                break;
                             case DELETE:
                             case EPOCH:
                             case DESC:
@@ -1063,23 +1392,11 @@ namespace pds{
                         }
                     }
                 }
-                // merge the results of in_use, resolve conflict
+                // resolve conflict within the shard we own
                 pthread_barrier_wait(&sync_point);
-                while (curr_reporting.load() != rec_tid)
-                    ;
-                for (auto itr : in_use_local) {
-                    auto found = in_use->find(itr.first);
-                    if (found == in_use->end()) {
-                        in_use->insert({itr.first, itr.second});
-                    } else if (found->second->get_epoch() <
-                               itr.second->get_epoch()) {
-                        not_in_use_local.push_back(found->second);
-                        found->second = itr.second;
-                    } else {
-                        not_in_use_local.push_back(itr.second);
-                    }
-                }
-                curr_reporting.store((rec_tid + 1) % rec_thd);
+                EpochSys::init_thread(rec_tid);
+                stream_cnts[rec_tid].ui = stream_shard(outboxes, rec_tid,
+                    clean_start, stream ? *stream : collect, not_in_use_local);
                 // clean up not_in_use and anti-nodes
                 for (auto itr : not_in_use_local) {
                     itr->set_epoch(NULL_EPOCH);
@@ -1097,6 +1414,27 @@ namespace pds{
             }
         }
 
+        if (stream) {
+            for (auto& cnt : stream_cnts) {
+                recovered_cnt += cnt.ui;
+            }
+            delete in_use;
+            in_use = nullptr;
+        } else {
+            // conflicts are already resolved in the shards, so this is
+            // a plain fill. Streaming recovery skips it.
+            size_t total = 0;
+            for (auto& shard : in_use_shards) {
+                total += shard.size();
+            }
+            in_use->reserve(total);
+            for (auto& shard : in_use_shards) {
+                for (PBlk* blk : shard) {
+                    in_use->insert({blk->get_id(), blk});
+                }
+            }
+            recovered_cnt = in_use->size();
+        }
         // set system mode back to online
         sys_mode = ONLINE;
 
@@ -1,13 +1,18 @@
 #ifndef EPOCH_HPP
 #define EPOCH_HPP
 
+#include <algorithm>
 #include <atomic>
+#include <functional>
+#include <vector>
 #include <unordered_map>
 #include <set>
 #include <map>
 #include <thread>
 #include <condition_variable>
 #include <string>
+#include <cstring>
+#include <utility>
 #include "TestConfig.hpp"
 #include "ConcurrentPrimitives.hpp"
 #include "PersistFunc.hpp"
@@ -34,7 +39,7 @@ struct OldSeeNewException : public std::exception {
     }
 };
 
-enum PBlkType {INIT, ALLOC, UPDATE, DELETE, RECLAIMED, EPOCH, OWNED, DESC};
+enum PBlkType {INIT, ALLOC, UPDATE, DELETE, RECLAIMED, EPOCH, OWNED, DESC, SNAPSHOT, TOMBSTONE};
 
 class EpochSys;
 
@@ -66,6 +71,9 @@ protected:
      */
     uint64_t epoch = NULL_EPOCH;
     PBlkType blktype = INIT;
+    // named root of the EpochDomain member owning this block; 0 if
+    // the epoch system isn't shared.
+    uint32_t root_tag = 0;
     // 16MSB for tid, 48LSB for sn; for nbEpochSys
     uint64_t tid_sn = 0;
     // uint64_t owner_id = 0; // TODO: make consider abandon this field and use id all the time.
@@ -83,9 +91,11 @@ public:
     PBlk(): retire(nullptr), epoch(NULL_EPOCH), blktype(INIT)/*, owner_id(0)*/{}
     // id gets inited by EpochSys instance.
     PBlk(const PBlk* owner):
-        retire(nullptr), blktype(OWNED)/*, owner_id(owner->blktype==OWNED? owner->owner_id : owner->id)*/ {}
-    PBlk(const PBlk& oth): retire(nullptr), blktype(oth.blktype==OWNED? OWNED:INIT)/*, owner_id(oth.owner_id)*/, id(oth.id) {}
+        retire(nullptr), blktype(OWNED), root_tag(owner->root_tag)/*, owner_id(owner->blktype==OWNED? owner->owner_id : owner->id)*/ {}
+    PBlk(const PBlk& oth): retire(nullptr), blktype(oth.blktype==OWNED? OWNED:INIT), root_tag(oth.root_tag)/*, owner_id(oth.owner_id)*/, id(oth.id) {}
     inline uint64_t get_id() {return id;}
+    inline uint32_t get_root_tag() const {return root_tag;}
+    inline void set_root_tag(uint32_t t) {root_tag = t;}
     virtual pptr<PBlk> get_data() {return nullptr;}
     virtual ~PBlk(){
         // Wentao: we need to zeroize epoch and flush it, avoiding it left after free
@@ -123,6 +133,18 @@ public:
     }
 };
 
+// bytes to allocate for a T constructed from args: T::size_of(args...)
+// if T has a variable-length tail sized by its constructor arguments,
+// sizeof(T) otherwise. Call as pblk_size<T>(0, args...).
+template<typename T, typename... Types>
+auto pblk_size(int, const Types&... args) -> decltype(T::size_of(args...)){
+    return T::size_of(args...);
+}
+template<typename T, typename... Types>
+size_t pblk_size(long, const Types&...){
+    return sizeof(T);
+}
+
 template<typename T>
 class PBlkArray : public PBlk{
     friend class EpochSys;
@@ -140,10 +162,56 @@ public:
 };
 
 struct Epoch : public PBlk{
+    static const int NAMED_ROOTS = 32;
+    static const size_t ROOT_NAME_LEN = 32;
     std::atomic<uint64_t> global_epoch;
+    // names of the roots registered by EpochDomain members; root i
+    // tags payloads with i+1. An empty name is a free slot.
+    char root_names[NAMED_ROOTS][ROOT_NAME_LEN];
     void persist(){}
     Epoch(){
         global_epoch.store(NULL_EPOCH, std::memory_order_relaxed);
+        memset(root_names, 0, sizeof(root_names));
+    }
+};
+
+struct sc_desc_t;
+
+// Table of live payloads written at a clean exit (see
+// EpochSys::write_snapshot()), so that the next restart can skip the
+// full-heap recovery scan. It is never tagged with an epoch, so a
+// recovery scan after a crash always throws it away.
+struct Snapshot : public PBlk{
+    pptr<Epoch> epoch_container;
+    uint64_t desc_cnt;
+    uint64_t pblk_cnt;
+    // followed by desc_cnt descriptor pointers and pblk_cnt payload
+    // pointers, the latter sorted by address.
+    Snapshot(uint64_t d, uint64_t p): PBlk(), desc_cnt(d), pblk_cnt(p){
+        blktype = SNAPSHOT;
+    }
+    inline pptr<sc_desc_t>* descs(){
+        return reinterpret_cast<pptr<sc_desc_t>*>((char*)this + sizeof(Snapshot));
+    }
+    inline pptr<PBlk>* pblks(){
+        return reinterpret_cast<pptr<PBlk>*>(descs() + desc_cnt);
+    }
+    static size_t size_of(uint64_t d, uint64_t p){
+        return sizeof(Snapshot) + d*sizeof(pptr<sc_desc_t>) + p*sizeof(pptr<PBlk>);
+    }
+};
+
+// Ids of payloads a thread deleted in an epoch, in place of one DELETE
+// anti-node per deletion (see EpochSys::log_tombstone()). Slots are
+// EMPTY until used; every slot written in the log's epoch is flushed
+// by the end of that epoch, along with the rest of the log.
+struct TombstoneLog : public PBlk{
+    static constexpr uint64_t EMPTY = ~0x0ULL;
+    static constexpr int CAPACITY = (1024 - sizeof(PBlk)) / sizeof(uint64_t);
+    uint64_t ids[CAPACITY];
+    TombstoneLog(): PBlk(){
+        blktype = TOMBSTONE;
+        std::fill(ids, ids + CAPACITY, EMPTY);
     }
 };
 
@@ -153,8 +221,13 @@ struct Epoch : public PBlk{
 
 enum SysMode {ONLINE, RECOVER};
 
+// called by recovery thread rec_tid with each surviving PBlk, for
+// streaming recovery.
+typedef std::function<void(PBlk* blk, int rec_tid)> RecoverCallback;
+// candidates of a recovery thread in streaming recovery, paired with
+// their ids and bucketed by the recovery thread owning each id shard.
+typedef std::vector<std::vector<std::pair<uint64_t, PBlk*>>> RecoverOutbox;
 
-struct sc_desc_t;
 
 template <class T>
 class atomic_lin_var;
@@ -230,6 +303,7 @@ protected:
      */
     uint64_t epoch = NULL_EPOCH;
     PBlkType blktype = DESC;
+    uint32_t root_tag = 0;
     // 16MSB for tid, 48LSB for sn; for nbEpochSys
     uint64_t tid_sn = 0;
     // for cnt in var:
@@ -378,7 +452,42 @@ protected:
     int task_num;
     static std::atomic<int> esys_num;
     padded<uint64_t>* last_epochs = nullptr;
+    // the tombstone log each thread is filling, the epoch it's for and
+    // how many ids it holds; transient.
+    struct TombstoneCursor{
+        TombstoneLog* log = nullptr;
+        uint64_t epoch = NULL_EPOCH;
+        int cnt = 0;
+    };
+    padded<TombstoneCursor>* tombstones = nullptr;
+    // epoch each thread holds through a held transaction, or
+    // NULL_EPOCH, and the last epoch an advance waits to leave.
+    paddedAtomic<uint64_t>* held_epochs = nullptr;
+    paddedAtomic<uint64_t> closing_epoch;
     std::unordered_map<uint64_t, PBlk*>* recovered = nullptr;
+    uint64_t recovered_cnt = 0;
+
+    // Ralloc root slot holding the snapshot of a clean exit.
+    static const uint64_t SNAPSHOT_ROOT = 0;
+    bool snapshot_on_exit = false;
+    bool snapshot_written = false;
+
+    // on a clean restart, fill in_use with the payloads recorded in
+    // the snapshot and return true; return false if there's none.
+    // In streaming recovery, hand them to stream instead.
+    bool load_snapshot(std::unordered_map<uint64_t, PBlk*>* in_use,
+        const RecoverCallback* stream, const int rec_thd);
+    // unlink the snapshot, if any, from the root. A snapshot left
+    // in the heap is reclaimed by the recovery scan as it never has
+    // an epoch.
+    void unlink_snapshot();
+    // take back a descriptor recorded in the snapshot.
+    virtual void restore_desc(sc_desc_t* desc);
+    // in recovery, resolve the id shard owned by rec_tid:
+    // hand the newest copy of each id to stream, and put the others
+    // in not_in_use. Return the number of PBlks handed over.
+    uint64_t stream_shard(std::vector<RecoverOutbox>& outboxes, const int rec_tid,
+        bool clean_start, const RecoverCallback& stream, std::vector<PBlk*>& not_in_use);
 
 public:
 
@@ -394,6 +503,12 @@ public:
         _ral = new Ralloc(_gtc->task_num+1,heap_name.c_str(),REGION_SIZE);
         local_descs = new sc_desc_t* [gtc->task_num] {nullptr};
         last_epochs = new padded<uint64_t>[_gtc->task_num];
+        tombstones = new padded<TombstoneCursor>[_gtc->task_num];
+        held_epochs = new paddedAtomic<uint64_t>[_gtc->task_num];
+        for (int i = 0; i < _gtc->task_num; i++){
+            held_epochs[i].ui.store(NULL_EPOCH);
+        }
+        closing_epoch.ui.store(NULL_EPOCH);
         // desc allocation and potential recovery are all in init()
 
     }
@@ -422,15 +537,16 @@ public:
         delete persisted_epochs;
         delete to_be_persisted;
         delete to_be_freed;
-        // Wentao: Due to the lack of snapshotting on transient
-        // indexing, we are unable to do fast recovery from clean
-        // exit for now. 
-        // Remove the following `set_fake_dirty()` routine if we
-        // eventually support snapshot and fast recovery from clean
-        // exit. 
-        _ral->set_fake_dirty();
+        // Without a snapshot of the transient index, we are unable
+        // to do fast recovery from this exit, so we force the next
+        // restart into a full recovery scan.
+        if (!snapshot_written){
+            _ral->set_fake_dirty();
+        }
         delete _ral;
         delete last_epochs;
+        delete[] tombstones;
+        delete[] held_epochs;
         if(recovered)
             delete recovered;
         // std::cout<<"Aborted:Total = "<<abort_cnt.load()<<":"<<total_cnt.load()<<std::endl;
@@ -483,16 +599,24 @@ public:
     // allocate a T-typed block on Ralloc and
     // construct using placement new
     template <class T, typename... Types>
-    T* new_pblk(Types... args){
-        T* ret = (T*)_ral->allocate(sizeof(T));
-        new (ret) T (args...);
+    T* new_pblk(Types&&... args){
+        T* ret = (T*)_ral->allocate(pblk_size<T>(0, args...));
+        new (ret) T (std::forward<Types>(args)...);
         return ret;
     }
 
+    // ~PBlk() clears the epoch so that a freed block isn't recovered,
+    // but the compiler may drop that store as the object dies right
+    // after; clear it again once the object is gone.
+    static inline void clear_epoch(PBlk* pblk){
+        *(volatile uint64_t*)&pblk->epoch = NULL_EPOCH;
+    }
+
     // deallocate pblk, giving it back to Ralloc
     template <class T>
     void delete_pblk(T* pblk, uint64_t c){
         pblk->~T();
+        clear_epoch(pblk);
         _ral->deallocate(pblk);
         if (sys_mode == ONLINE && c != NULL_EPOCH){
             if (EpochSys::tid >= gtc->task_num){
@@ -504,6 +628,33 @@ public:
         }
     }
 
+    // deallocate a batch of pblks, all freed for epoch c, giving them
+    // back to Ralloc at once. Reorders pblks.
+    void delete_pblks(std::vector<PBlk*>& pblks, uint64_t c){
+        for (PBlk* pblk : pblks){
+            pblk->~PBlk();
+            clear_epoch(pblk);
+        }
+        _ral->deallocate_batch((void**)pblks.data(), pblks.size());
+        if (sys_mode == ONLINE && c != NULL_EPOCH){
+            for (PBlk* pblk : pblks){
+                if (EpochSys::tid >= gtc->task_num){
+                    persist_func::clwb(pblk);
+                } else {
+                    to_be_persisted->register_persist_raw(pblk, c);
+                }
+            }
+        }
+    }
+
+    // record, in this thread's tombstone log of epoch c, that the
+    // payload blk is deleted in c.
+    virtual void log_tombstone(const PBlk* blk, uint64_t c);
+
+    // record the deletion with a DELETE anti-node instead. The
+    // anti-node carries blk's id, root tag and transaction (tid_sn).
+    void new_anti_node(const PBlk* blk, uint64_t c);
+
     // check if global is the same as c.
     bool check_epoch(uint64_t c);
 
@@ -521,6 +672,16 @@ public:
     // end transaction, release the holding of epoch increments.
     virtual void end_transaction(uint64_t c);
 
+    // start another op in transaction c, which is still held and
+    // current, without registering again. Used by batches.
+    virtual void continue_transaction(uint64_t c);
+
+    // start a transaction whose epoch c doesn't end until
+    // end_held_transaction(c): meanwhile, no op of any thread runs in
+    // an epoch after c. Blocking only.
+    uint64_t begin_held_transaction();
+    void end_held_transaction(uint64_t c);
+
     // auto begin and end a reclaim-only transaction
     virtual uint64_t begin_reclaim_transaction();
     virtual void end_reclaim_transaction(uint64_t c);
@@ -556,6 +717,10 @@ public:
     // called by the API.
     void register_update_pblk(PBlk* b, uint64_t c);
 
+    // register update of only the sz bytes at start in PBlk b, which
+    // must be already registered in full in epoch c.
+    void register_update_pblk_range(PBlk* b, void* start, size_t sz, uint64_t c);
+
     // free a PBlk during a transaction.
     template<typename T>
     void free_pblk(T* b, uint64_t c);
@@ -585,11 +750,29 @@ public:
     template<typename T>
     T* openwrite_pblk(T* b, uint64_t c);
 
+    // get a writable copy of a PBlk, constructed from args and sized
+    // for them, for a b that has to grow or shrink.
+    template<typename T, typename... Types>
+    T* reallocate_pblk(T* b, uint64_t c, Types&&... args);
+
     // block, call for persistence of epoch c, and wait until finish.
     void sync(){
         epoch_advancer->sync(last_epochs[tid].ui);
     }
 
+    bool snapshot_enabled() const {
+        return snapshot_on_exit;
+    }
+
+    // tag of the named root, registering the name in the epoch
+    // container if it's new. Not thread-safe; call after init().
+    uint32_t get_root_tag(const std::string& name);
+
+    // persist the live payloads into a snapshot so that the next
+    // restart from this clean exit doesn't scan the heap. Must be
+    // called by a single thread after all operations have quiesced.
+    void write_snapshot(std::vector<PBlk*>& live);
+
     /////////////////
     // Bookkeeping //
     /////////////////
@@ -597,6 +780,17 @@ public:
     // get the current global epoch number.
     uint64_t get_epoch();
 
+    // start counting the blocks registered for write-back.
+    void count_persist_volume(){
+        to_be_persisted->count_volume = true;
+    }
+
+    // number of blocks registered for write-back since
+    // count_persist_volume().
+    uint64_t get_persist_volume(){
+        return to_be_persisted->registered();
+    }
+
     bool epoch_CAS(uint64_t& expected, const uint64_t& desired){
         return global_epoch->compare_exchange_strong(expected, desired);
     }
@@ -621,19 +815,18 @@ public:
     /////////////
     // Recover //
     /////////////
-    virtual void init() {
+    // if stream is given, recovered PBlks are handed to it by the
+    // recovery threads instead of being collected in get_recovered().
+    virtual void init(const RecoverCallback* stream = nullptr) {
         bool restart=_ral->is_restart();
         if (restart) {
-            int rec_thd = gtc->task_num;
-            if (gtc->checkEnv("RecoverThread")){
-                rec_thd = stoi(gtc->getEnv("RecoverThread"));
-            }
+            int rec_thd = get_rec_thd();
             auto begin = chrono::high_resolution_clock::now();
-            recovered = recover(rec_thd);
+            recovered = recover(rec_thd, stream);
             auto end = chrono::high_resolution_clock::now();
             auto dur = end - begin;
             auto dur_ms = std::chrono::duration_cast<std::chrono::milliseconds>(dur).count();
-            std::cout << "Spent " << dur_ms << "ms getting PBlk(" << recovered->size() << ")" << std::endl;
+            std::cout << "Spent " << dur_ms << "ms getting PBlk(" << recovered_cnt << ")" << std::endl;
         }
         for(int i=0;i<gtc->task_num;i++){
             assert(local_descs[i]==nullptr);
@@ -649,8 +842,22 @@ public:
         return (recovered);
     }
 
-    // recover all PBlk decendants. return an iterator.
-    virtual std::unordered_map<uint64_t, PBlk*>* recover(const int rec_thd = 2);
+    uint64_t get_recovered_cnt() {
+        return recovered_cnt;
+    }
+
+    // number of threads recovery runs with.
+    int get_rec_thd() {
+        int rec_thd = gtc->task_num;
+        if (gtc->checkEnv("RecoverThread")){
+            rec_thd = stoi(gtc->getEnv("RecoverThread"));
+        }
+        return rec_thd;
+    }
+
+    // recover all PBlk decendants. return an iterator, or nullptr if
+    // they are streamed to stream.
+    virtual std::unordered_map<uint64_t, PBlk*>* recover(const int rec_thd = 2, const RecoverCallback* stream = nullptr);
 };
 
 class nbEpochSys : public EpochSys {
@@ -660,19 +867,16 @@ class nbEpochSys : public EpochSys {
     // starts in epoch c; this must contain only reset payloads
     void local_persist(uint64_t c);
    public:
-    virtual void init() override {
+    virtual void init(const RecoverCallback* stream = nullptr) override {
         bool restart=_ral->is_restart();
         if (restart) {
-            int rec_thd = gtc->task_num;
-            if (gtc->checkEnv("RecoverThread")){
-                rec_thd = stoi(gtc->getEnv("RecoverThread"));
-            }
+            int rec_thd = get_rec_thd();
             auto begin = chrono::high_resolution_clock::now();
-            recovered = recover(rec_thd);
+            recovered = recover(rec_thd, stream);
             auto end = chrono::high_resolution_clock::now();
             auto dur = end - begin;
             auto dur_ms = std::chrono::duration_cast<std::chrono::milliseconds>(dur).count();
-            std::cout << "Spent " << dur_ms << "ms getting PBlk(" << recovered->size() << ")" << std::endl;
+            std::cout << "Spent " << dur_ms << "ms getting PBlk(" << recovered_cnt << ")" << std::endl;
         }
         bool reached_all_reused_descs = false; // for debugging
         for(int i=0;i<gtc->task_num;i++){
@@ -695,6 +899,7 @@ class nbEpochSys : public EpochSys {
     }
     virtual uint64_t begin_transaction() override;
     virtual void end_transaction(uint64_t c) override;
+    virtual void continue_transaction(uint64_t c) override;
     virtual uint64_t begin_reclaim_transaction() override;
     virtual void end_reclaim_transaction(uint64_t c) override;
     virtual void end_readonly_transaction(uint64_t c) override{
@@ -705,8 +910,9 @@ class nbEpochSys : public EpochSys {
     };
     virtual void on_epoch_begin(uint64_t c) override;
     virtual void on_epoch_end(uint64_t c) override;
-    virtual std::unordered_map<uint64_t, PBlk*>* recover(const int rec_thd = 2) override;
+    virtual std::unordered_map<uint64_t, PBlk*>* recover(const int rec_thd = 2, const RecoverCallback* stream = nullptr) override;
     /*{assert(0&&"not implemented yet"); return {};}*/
+    virtual void restore_desc(sc_desc_t* desc) override;
 
     virtual void register_alloc_pblk(PBlk* b, uint64_t c) override;
    // for nonblocking persistence, prepare to retire a PBlk during a transaction.
@@ -717,6 +923,14 @@ class nbEpochSys : public EpochSys {
     // for nonblocking persistence, retire a PBlk during a transaction.
     virtual void retire_pblk(PBlk* b, uint64_t c, PBlk* anti=nullptr) override;
 
+    // recovery checks each anti-node against a transaction, which a
+    // tombstone log doesn't record; keep the anti-nodes. One made here
+    // takes the transaction that created the deleted block, so it
+    // counts exactly when that block is itself recovered.
+    virtual void log_tombstone(const PBlk* blk, uint64_t c) override{
+        new_anti_node(blk, c);
+    }
+
     nbEpochSys(GlobalTestConfig* _gtc) : EpochSys(_gtc){
 #ifdef VISIBLE_READ
         // ensure nbEpochSys is used only when VISIBLE_READ is not
@@ -816,16 +1030,7 @@ void EpochSys::free_pblk(T* b, uint64_t c){
             errexit("double free error.");
         }
     } else {
-        // NOTE: The deletion node will be essentially "leaked" during online phase,
-        // which may fundamentally confuse valgrind.
-        // Consider keeping reference of all delete node for debugging purposes.
-        PBlk* del = new_pblk<PBlk>(*blk);
-        del->blktype = DELETE;
-        del->epoch = c;
-        // to_be_persisted[c%4].push(del);
-        to_be_persisted->register_persist(del, c);
-        // to_be_freed[(c+1)%4].push(del);
-        to_be_freed->register_free(del, c+1);
+        log_tombstone(blk, c);
     }
     // to_be_freed[c%4].push(b);
     to_be_freed->register_free(b, c);
@@ -913,6 +1118,31 @@ T* EpochSys::openwrite_pblk(T* b, uint64_t c){
     return b;
 }
 
+template<typename T, typename... Types>
+T* EpochSys::reallocate_pblk(T* b, uint64_t c, Types&&... args){
+    ASSERT_DERIVE(T, PBlk);
+    ASSERT_COPY(T);
+
+    validate_access(b, c);
+    PBlk* old = b;
+    T* ret = new_pblk<T>(std::forward<Types>(args)...);
+    PBlk* blk = ret;
+    assert(blk->id == old->id);
+    blk->root_tag = old->root_tag;
+    blk->epoch = c;
+    if (old->epoch < c){
+        blk->blktype = UPDATE;
+        to_be_freed->register_free(b, c);
+    } else {
+        // b is of epoch c too, so recovery couldn't tell the two
+        // apart; b has to go now. Writers of an epoch-c block own it.
+        blk->blktype = old->blktype;
+        delete_pblk(b, c);
+    }
+    // registered for persistence by the API module, as in openwrite_pblk.
+    return ret;
+}
+
 }
 
 #endif
\ No newline at end of file
@@ -10,36 +10,138 @@ void ThreadLocalFreedContainer::do_free(PBlk*& x, uint64_t c){
 ThreadLocalFreedContainer::ThreadLocalFreedContainer(EpochSys* e, GlobalTestConfig* gtc): task_num(gtc->task_num){
     container = new VectorContainer<PBlk*>(gtc->task_num);
     threadEpoch = new padded<uint64_t>[gtc->task_num];
+    locks = new padded<std::mutex>[gtc->task_num];
+    stats = new padded<FreeStats>[gtc->task_num];
     _esys = e;
     for(int i = 0; i < gtc->task_num; i++){
         threadEpoch[i] = INIT_EPOCH;
     }
+    if (gtc->checkEnv("IdleFreeEpochs")){
+        idle_epochs = stoull(gtc->getEnv("IdleFreeEpochs"));
+        // an idle thread may still have blocks in the bucket after
+        // its last epoch, which is freeable only 3 epochs later
+        if (idle_epochs != 0 && idle_epochs < 3){
+            errexit("IdleFreeEpochs must be 0 or at least 3");
+        }
+    }
+    if (gtc->checkEnv("BatchFree")){
+        batch = (gtc->getEnv("BatchFree") != "0");
+    }
+    verbose = gtc->verbose;
 }
 ThreadLocalFreedContainer::~ThreadLocalFreedContainer(){
+    if (verbose){
+        for (int i = 0; i < task_num; i++){
+            FreeStats& s = stats[i].ui;
+            if (s.retired.load() == 0) continue;
+            std::cout<<"thread "<<i<<" to-be-freed: retired "<<s.retired.load()<<
+                ", freed by others "<<s.reclaimed.load()<<
+                ", peak backlog "<<s.peak<<
+                ", left at exit "<<backlog(i)<<std::endl;
+        }
+    }
     delete container;
+    delete[] threadEpoch;
+    delete[] locks;
+    delete[] stats;
+}
+uint64_t ThreadLocalFreedContainer::free_local(uint64_t c, int tid){
+    if (!batch){
+        uint64_t cnt = 0;
+        container->pop_all_local([&,this](PBlk*& x){this->do_free(x, c); cnt++;}, tid, c);
+        return cnt;
+    }
+    std::vector<PBlk*> blks;
+    container->pop_all_local([&](PBlk*& x){blks.push_back(x);}, tid, c);
+    if (!blks.empty()){
+        _esys->delete_pblks(blks, c);
+    }
+    return blks.size();
+}
+uint64_t ThreadLocalFreedContainer::free_buckets(uint64_t last_epoch, uint64_t c, int tid){
+    // There are at most three buckets not cleaned up,
+    // last_epoch-1, last_epoch, and last_epoch+1. Only buckets <= c
+    // are freed.
+    uint64_t cnt = 0;
+    for (uint64_t i = last_epoch-1;
+        i <= min(last_epoch+1, c); i++){
+        cnt += free_local(i, tid);
+        persist_func::sfence();
+    }
+    return cnt;
 }
 void ThreadLocalFreedContainer::free_on_new_epoch(uint64_t c){
-    auto last_epoch = threadEpoch[EpochSys::tid].ui;
+    int tid = EpochSys::tid;
+    auto last_epoch = threadEpoch[tid].ui;
     if (last_epoch == c){
         return;
     }
-    threadEpoch[EpochSys::tid].ui = c;
-    for (uint64_t i = last_epoch-1;
-        i <= min(last_epoch+1, c-2); i++){
-        help_free_local(i);
-        persist_func::sfence();
-    }
+    // taken once per epoch; waits only if someone is freeing for us
+    std::lock_guard<std::mutex> lk(locks[tid].ui);
+    threadEpoch[tid].ui = c;
+    FreeStats& s = stats[tid].ui;
+    s.freed.store(s.freed.load(std::memory_order_relaxed) +
+        free_buckets(last_epoch, c-2, tid), std::memory_order_relaxed);
 }
 void ThreadLocalFreedContainer::register_free(PBlk* blk, uint64_t c){
     assert(blk!=nullptr);
     // container[c%4].ui->push(blk, EpochSys::tid);
     container->push(blk, EpochSys::tid, c);
+    FreeStats& s = stats[EpochSys::tid].ui;
+    uint64_t retired = s.retired.load(std::memory_order_relaxed) + 1;
+    s.retired.store(retired, std::memory_order_relaxed);
+    uint64_t pending = retired - s.freed.load(std::memory_order_relaxed) -
+        s.reclaimed.load(std::memory_order_relaxed);
+    if (pending > s.peak){
+        s.peak = pending;
+    }
 }
 void ThreadLocalFreedContainer::help_free(uint64_t c){
-    // do nothing. all frees should be done by worker threads.
+    // Frees are done by worker threads as they begin operations in
+    // new epochs. This frees, up to epoch c, for those that haven't
+    // for a while, so that an idle thread doesn't keep its blocks.
+    if (idle_epochs == 0){
+        return;
+    }
+    for (int i = 0; i < task_num; i++){
+        if (backlog(i) == 0){
+            continue;
+        }
+        std::unique_lock<std::mutex> lk(locks[i].ui, std::try_to_lock);
+        if (!lk.owns_lock()){
+            // the owner is back, or someone else is freeing for it
+            continue;
+        }
+        // Under the lock threadEpoch is the last epoch the owner
+        // began an operation in, and the owner can't register any
+        // block until it gets the lock on its next operation.
+        auto last_epoch = threadEpoch[i].ui;
+        if (last_epoch == INIT_EPOCH || last_epoch + idle_epochs > c + 2){
+            continue;
+        }
+        FreeStats& s = stats[i].ui;
+        s.reclaimed.store(s.reclaimed.load(std::memory_order_relaxed) +
+            free_buckets(last_epoch, c, i), std::memory_order_relaxed);
+    }
 }
 void ThreadLocalFreedContainer::help_free_local(uint64_t c){
-    container->pop_all_local([&,this](PBlk*& x){this->do_free(x, c);}, EpochSys::tid, c);
+    FreeStats& s = stats[EpochSys::tid].ui;
+    s.freed.store(s.freed.load(std::memory_order_relaxed) +
+        free_local(c, EpochSys::tid), std::memory_order_relaxed);
+}
+void ThreadLocalFreedContainer::free_all(const std::function<void(PBlk*&)>& func){
+    for (uint64_t i = 0; i < EPOCH_WINDOW; i++){
+        container->pop_all(func, i);
+    }
+}
+uint64_t ThreadLocalFreedContainer::backlog(int tid){
+    FreeStats& s = stats[tid].ui;
+    return s.retired.load(std::memory_order_relaxed) -
+        s.freed.load(std::memory_order_relaxed) -
+        s.reclaimed.load(std::memory_order_relaxed);
+}
+uint64_t ThreadLocalFreedContainer::reclaimed(int tid){
+    return stats[tid].ui.reclaimed.load(std::memory_order_relaxed);
 }
 void ThreadLocalFreedContainer::clear(){
     container->clear();
@@ -52,6 +154,9 @@ void PerEpochFreedContainer::do_free(PBlk*& x, uint64_t c){
 PerEpochFreedContainer::PerEpochFreedContainer(EpochSys* e, GlobalTestConfig* gtc){
     container = new VectorContainer<PBlk*>(gtc->task_num);
     _esys = e;
+    if (gtc->checkEnv("BatchFree")){
+        batch = (gtc->getEnv("BatchFree") != "0");
+    }
     // container = new HashSetContainer<PBlk*>(gtc->task_num);
 }
 PerEpochFreedContainer::~PerEpochFreedContainer(){
@@ -63,10 +168,31 @@ void PerEpochFreedContainer::register_free(PBlk* blk, uint64_t c){
     container->push(blk, EpochSys::tid, c);
 }
 void PerEpochFreedContainer::help_free(uint64_t c){
-    container->pop_all([&,this](PBlk*& x){this->do_free(x, c);}, c);
+    if (!batch){
+        container->pop_all([&,this](PBlk*& x){this->do_free(x, c);}, c);
+        return;
+    }
+    std::vector<PBlk*> blks;
+    container->pop_all([&](PBlk*& x){blks.push_back(x);}, c);
+    if (!blks.empty()){
+        _esys->delete_pblks(blks, c);
+    }
 }
 void PerEpochFreedContainer::help_free_local(uint64_t c){
-    container->pop_all_local([&,this](PBlk*& x){this->do_free(x, c);}, EpochSys::tid, c);
+    if (!batch){
+        container->pop_all_local([&,this](PBlk*& x){this->do_free(x, c);}, EpochSys::tid, c);
+        return;
+    }
+    std::vector<PBlk*> blks;
+    container->pop_all_local([&](PBlk*& x){blks.push_back(x);}, EpochSys::tid, c);
+    if (!blks.empty()){
+        _esys->delete_pblks(blks, c);
+    }
+}
+void PerEpochFreedContainer::free_all(const std::function<void(PBlk*&)>& func){
+    for (uint64_t i = 0; i < EPOCH_WINDOW; i++){
+        container->pop_all(func, i);
+    }
 }
 void PerEpochFreedContainer::clear(){
     container->clear();
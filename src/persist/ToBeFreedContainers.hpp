@@ -1,7 +1,11 @@
 #ifndef TO_BE_FREED_CONTAINERS_HPP
 #define TO_BE_FREED_CONTAINERS_HPP
 
+#include <atomic>
 #include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
 
 #include "TestConfig.hpp"
 #include "PerThreadContainers.hpp"
@@ -22,16 +26,42 @@ public:
     virtual void help_free_local(uint64_t c) {};
     virtual void clear() = 0;
     virtual void free_on_new_epoch(uint64_t c){};
+    // hand every registered block of every thread to func. Only
+    // called when no thread is in an operation, e.g. at exit.
+    virtual void free_all(const std::function<void(PBlk*&)>& func){};
+    // blocks thread tid registered that are not freed yet
+    virtual uint64_t backlog(int tid){return 0;}
+    // whether register_free() frees the block right away
+    virtual bool frees_immediately(){return false;}
     virtual ~ToBeFreedContainer(){}
 };
 
 class ThreadLocalFreedContainer : public ToBeFreedContainer{
+    // per-thread counters; each is written by one thread at a time
+    // (retired by the owner, freed and reclaimed under locks[tid])
+    struct FreeStats{
+        std::atomic<uint64_t> retired{0};
+        std::atomic<uint64_t> freed{0};
+        std::atomic<uint64_t> reclaimed{0};
+        uint64_t peak = 0;
+    };
     PerThreadContainer<PBlk*>* container = nullptr;
     padded<uint64_t>* threadEpoch;
+    // held by the owner while it frees on a new epoch, and by whoever
+    // frees for it while it's idle
     padded<std::mutex>* locks = nullptr;
+    padded<FreeStats>* stats = nullptr;
     int task_num;
+    // a thread that hasn't begun an operation for this many epochs
+    // has its buckets freed by help_free(); 0 disables that
+    uint64_t idle_epochs = 8;
+    // hand each bucket to Ralloc in one batch rather than block by block
+    bool batch = true;
+    bool verbose = false;
     EpochSys* _esys = nullptr;
     void do_free(PBlk*& x, uint64_t c);
+    uint64_t free_local(uint64_t c, int tid);
+    uint64_t free_buckets(uint64_t last_epoch, uint64_t c, int tid);
 public:
     ThreadLocalFreedContainer(EpochSys* e):_esys(e){}
     ThreadLocalFreedContainer(EpochSys* e, GlobalTestConfig* gtc);
@@ -42,12 +72,17 @@ public:
     void register_free(PBlk* blk, uint64_t c);
     void help_free(uint64_t c);
     void help_free_local(uint64_t c);
+    void free_all(const std::function<void(PBlk*&)>& func);
+    uint64_t backlog(int tid);
+    // blocks of thread tid freed by other threads while it was idle
+    uint64_t reclaimed(int tid);
     void clear();
 };
 
 class PerEpochFreedContainer : public ToBeFreedContainer{
     PerThreadContainer<PBlk*>* container = nullptr;
     EpochSys* _esys = nullptr;
+    bool batch = true;
     void do_free(PBlk*& x, uint64_t c);
    public:
     PerEpochFreedContainer(EpochSys* e):_esys(e){
@@ -59,6 +94,7 @@ class PerEpochFreedContainer : public ToBeFreedContainer{
     void register_free(PBlk* blk, uint64_t c);
     void help_free(uint64_t c);
     void help_free_local(uint64_t c);
+    void free_all(const std::function<void(PBlk*&)>& func);
     void clear();
 };
 
@@ -68,6 +104,7 @@ class NoToBeFreedContainer : public ToBeFreedContainer{
 public:
     NoToBeFreedContainer(EpochSys* e):_esys(e){}
     virtual void register_free(PBlk* blk, uint64_t c);
+    bool frees_immediately(){return true;}
     void free_on_new_epoch(uint64_t c){}
     virtual void help_free(uint64_t c){}
     virtual void help_free_local(uint64_t c){}
@@ -3,7 +3,7 @@
 
 using namespace pds;
 
-void rebuild_affinity(GlobalTestConfig* gtc, std::vector<hwloc_obj_t>& persister_affinities){
+static void rebuild_affinity(GlobalTestConfig* gtc, std::vector<hwloc_obj_t>& persister_affinities){
     // re-build worker thread affinity that pin current threads to individual cores
     // build affinities that pin persisters to hyperthreads of worker threads
     gtc->affinities.clear();
@@ -19,128 +19,104 @@ void rebuild_affinity(GlobalTestConfig* gtc, std::vector<hwloc_obj_t>& persister
     }
 }
 
-// void BufferedWB::PerThreadDedicatedWait::persister_main(int worker_id){
-//     // pin this thread to hyperthreads of worker threads.
-//     hwloc_set_cpubind(gtc->topology, 
-//         persister_affinities[worker_id]->cpuset,HWLOC_CPUBIND_THREAD);
-//     // spin until signaled to destruct.
-//     int last_signal = 0;
-//     while(!exit.load(std::memory_order_acquire)){
-//         // wait on worker (tid == worker_id) thread's signal.
-//         std::unique_lock<std::mutex> lck(signals[worker_id].bell);
-//         signals[worker_id].ring.wait(lck, [&]{return (last_signal != signals[worker_id].curr);});
-//         last_signal = signals[worker_id].curr;
-//         // dumps
-//         for (int i = 0; i < con->dump_size; i++){
-//             con->container->try_pop_local(&do_persist, worker_id, signals[worker_id].epoch);
-//         }
-//     }
-// }
-// BufferedWB::PerThreadDedicatedWait::PerThreadDedicatedWait(BufferedWB* _con, GlobalTestConfig* _gtc) :
-//     Persister(_con), gtc(_gtc) {
-//     rebuild_affinity(gtc, persister_affinities);
-//     // init environment
-//     exit.store(false, std::memory_order_relaxed);
-//     signals = new Signal[gtc->task_num];
-//     // spawn threads
-//     for (int i = 0; i < gtc->task_num; i++){
-//         persisters.push_back(std::move(
-//             std::thread(&PerThreadDedicatedWait::persister_main, this, i)));
-//     }
-// }
-// BufferedWB::PerThreadDedicatedWait::~PerThreadDedicatedWait(){
-//     // signal exit of worker threads.
-//     exit.store(true, std::memory_order_release);
-//     for (int i = 0; i < gtc->task_num; i++){
-//         // TODO: lock here?
-//         signals[i].curr++;
-//         signals[i].ring.notify_one();
-//     }
-//     // join threads
-//     for (auto i = persisters.begin(); i != persisters.end(); i++){
-//         if (i->joinable()){
-//             // std::cout<<"joining thread."<<std::endl;
-//             i->join();
-//             // std::cout<<"joined."<<std::endl;
-//         }
-//     }
-//     delete signals;
-// }
-// void BufferedWB::PerThreadDedicatedWait::help_persist_local(uint64_t c){
-//     // notify hyperthread.
-//     {
-//         std::unique_lock<std::mutex> lck(signals[EpochSys::tid].bell);
-//         signals[EpochSys::tid].curr++;
-//         signals[EpochSys::tid].epoch = c;
-//     }
-//     signals[EpochSys::tid].ring.notify_one();
-// }
-
-// void BufferedWB::PerThreadDedicatedBusy::persister_main(int worker_id){
-//     // pin this thread to hyperthreads of worker threads.
-//     hwloc_set_cpubind(gtc->topology, 
-//         persister_affinities[worker_id]->cpuset,HWLOC_CPUBIND_THREAD);
-//     // spin until signaled to destruct.
-//     int last_signal = 0;
-//     int curr_signal = 0;
-//     uint64_t curr_epoch = NULL_EPOCH;
-//     while(!exit){
-//         // wait on worker (tid == worker_id) thread's signal.
-//         while(true){
-//             if (exit.load(std::memory_order_acquire)){
-//                 return;
-//             }
-//             curr_signal = signals[worker_id].curr.load(std::memory_order_acquire);
-//             if (curr_signal != last_signal){
-//                 break;
-//             }
-//         }
-//         curr_epoch = signals[worker_id].epoch;
-//         // dumps
-//         for (int i = 0; i < con->dump_size; i++){
-//             con->container->try_pop_local(&do_persist, worker_id, curr_epoch);
-//         }
-//         signals[worker_id].ack.fetch_add(1, std::memory_order_release);
-//         last_signal = curr_signal;
-//     }
-// }
-// BufferedWB::PerThreadDedicatedBusy::PerThreadDedicatedBusy(BufferedWB* _con, GlobalTestConfig* _gtc) :
-//     Persister(_con), gtc(_gtc) {
-//     rebuild_affinity(gtc, persister_affinities);
-//     // init environment
-//     exit.store(false, std::memory_order_relaxed);
-//     signals = new Signal[gtc->task_num];
-//     // spawn threads
-//     for (int i = 0; i < gtc->task_num; i++){
-//         signals[i].curr.store(0, std::memory_order_relaxed);
-//         signals[i].ack.store(0, std::memory_order_relaxed);
-//         persisters.push_back(std::move(
-//             std::thread(&PerThreadDedicatedBusy::persister_main, this, i)));
-//     }
-// }
-// BufferedWB::PerThreadDedicatedBusy::~PerThreadDedicatedBusy(){
-//     // signal exit of worker threads.
-//     exit.store(true, std::memory_order_release);
-//     // join threads
-//     for (auto i = persisters.begin(); i != persisters.end(); i++){
-//         if (i->joinable()){
-//             i->join();
-//         }
-//     }
-//     delete signals;
-// }
-// void BufferedWB::PerThreadDedicatedBusy::help_persist_local(uint64_t c){
-//     // notify hyperthread.
-//     signals[EpochSys::tid].epoch = c;
-//     int prev = signals[EpochSys::tid].curr.fetch_add(1, std::memory_order_release);
-//     // make sure the persister gets the correct epoch.
-//     while(prev == signals[EpochSys::tid].ack.load(std::memory_order_acquire));
-// }
-// void BufferedWB::WorkerThreadPersister::help_persist_local(uint64_t c){
-//     for (int i = 0; i < con->dump_size; i++){
-//         con->container->try_pop_local(&do_persist, EpochSys::tid, c);
-//     }
-// }
+void BufferedWB::PerThreadDedicated::persister_main(int worker_id){
+    // pin this thread to the hyperthread of its worker.
+    hwloc_set_cpubind(gtc->topology, 
+        persister_affinities[worker_id]->cpuset,HWLOC_CPUBIND_THREAD);
+    Handoff& h = handoffs[worker_id];
+    WBStats& st = con->wb_stats[gtc->task_num+1+worker_id].ui;
+    uint64_t done = 0;
+    while(true){
+        uint64_t pushed = h.pushed.load(std::memory_order_acquire);
+        if (pushed == done){
+            // idle; only exit with an empty queue.
+            if (exit.load(std::memory_order_acquire)){
+                return;
+            }
+            if (!busy){
+                std::unique_lock<std::mutex> lck(h.bell);
+                h.sleeping.store(true);
+                // the timeout guards against a missed ring.
+                h.ring.wait_for(lck, std::chrono::milliseconds(1), [&]{
+                    return h.pushed.load() != done || exit.load();
+                });
+                h.sleeping.store(false);
+            }
+            continue;
+        }
+        for (; done < pushed; done++){
+            con->do_persist(h.slots[done % cap], st);
+        }
+        persist_func::sfence();
+        h.done.store(done, std::memory_order_release);
+    }
+}
+BufferedWB::PerThreadDedicated::PerThreadDedicated(BufferedWB* _con, GlobalTestConfig* _gtc, bool _busy, size_t _cap) :
+    con(_con), gtc(_gtc), busy(_busy), cap(_cap) {
+    hwloc_obj_t core = hwloc_get_obj_by_type(gtc->topology, HWLOC_OBJ_CORE, 0);
+    if (core == nullptr || core->arity < 2){
+        errexit("Persister needs cores with at least 2 hyperthreads.");
+    }
+    if (cap == 0){
+        errexit("PersisterQueue must be positive.");
+    }
+    rebuild_affinity(gtc, persister_affinities);
+    // init environment
+    exit.store(false, std::memory_order_relaxed);
+    handoffs = new Handoff[gtc->task_num];
+    // spawn threads
+    for (int i = 0; i < gtc->task_num; i++){
+        handoffs[i].pushed.store(0, std::memory_order_relaxed);
+        handoffs[i].done.store(0, std::memory_order_relaxed);
+        handoffs[i].sleeping.store(false, std::memory_order_relaxed);
+        handoffs[i].slots = new void*[cap];
+        persisters.push_back(std::move(
+            std::thread(&PerThreadDedicated::persister_main, this, i)));
+    }
+}
+BufferedWB::PerThreadDedicated::~PerThreadDedicated(){
+    // signal exit of persister threads.
+    exit.store(true, std::memory_order_release);
+    for (int i = 0; i < gtc->task_num; i++){
+        std::lock_guard<std::mutex> lck(handoffs[i].bell);
+        handoffs[i].ring.notify_one();
+    }
+    // join threads
+    for (auto i = persisters.begin(); i != persisters.end(); i++){
+        if (i->joinable()){
+            i->join();
+        }
+    }
+    for (int i = 0; i < gtc->task_num; i++){
+        delete[] handoffs[i].slots;
+    }
+    delete[] handoffs;
+}
+bool BufferedWB::PerThreadDedicated::hand_off(void* addr, int tid){
+    if (tid < 0 || tid >= gtc->task_num){
+        // the advancer and other non-worker threads have no persister.
+        return false;
+    }
+    Handoff& h = handoffs[tid];
+    uint64_t pushed = h.pushed.load(std::memory_order_relaxed);
+    if (pushed - h.done.load(std::memory_order_acquire) >= cap){
+        return false;
+    }
+    h.slots[pushed % cap] = addr;
+    h.pushed.store(pushed + 1);
+    if (!busy && h.sleeping.load()){
+        std::lock_guard<std::mutex> lck(h.bell);
+        h.ring.notify_one();
+    }
+    return true;
+}
+void BufferedWB::PerThreadDedicated::drain(int tid){
+    Handoff& h = handoffs[tid];
+    uint64_t target = h.pushed.load(std::memory_order_acquire);
+    while (h.done.load(std::memory_order_acquire) < target){
+        std::this_thread::yield();
+    }
+}
 void ToBePersistContainer::init_desc_local(void* addr, int tid){
     // Hs: currently we only have descs as per-thread persistent metadata, so
     // recording addrs of descs at init time might seem unecessary.
@@ -166,12 +142,108 @@ void ToBePersistContainer::do_persist_desc_local(uint64_t c, int tid) {
     }
 }
 
+BufferedWB::~BufferedWB(){
+    // the persisters drain their queues before exiting.
+    delete persister;
+    delete container;
+    if (gtc->verbose){
+        WBStats total;
+        for (int i = 0; i < 2*task_num+1; i++){
+            total.clwbs += wb_stats[i].ui.clwbs.load();
+            total.xplines += wb_stats[i].ui.xplines.load();
+            total.flushes += wb_stats[i].ui.flushes.load();
+        }
+        std::cout<<"write-back: "<<total.clwbs<<" clwbs ("<<
+            total.clwbs*CACHE_LINE_SIZE<<" bytes)";
+        if (sorted){
+            std::cout<<" in "<<total.xplines<<" XPLines";
+        }
+        std::cout<<", "<<total.flushes<<" epoch buffers flushed";
+        if (total.flushes > 0){
+            std::cout<<", "<<(double)total.clwbs/total.flushes<<" clwbs ("<<
+                (double)total.clwbs*CACHE_LINE_SIZE/total.flushes<<" bytes) per buffer";
+        }
+        std::cout<<std::endl;
+    }
+    delete[] wb_stats;
+}
+BufferedWB::WBStats& BufferedWB::local_stats(){
+    return wb_stats[stat_slot(EpochSys::tid)].ui;
+}
 void BufferedWB::do_persist(void*& addr) {
+    do_persist(addr, local_stats());
+}
+void BufferedWB::do_persist(void*& addr, WBStats& st) {
     if (is_raw(addr)){
         persist_func::clwb(unmark_raw(addr));
+        st.add(st.clwbs, 1);
+    } else if (is_lines(addr)){
+        char* line = (char*)unmark_lines(addr);
+        uint64_t n = lines_of(addr);
+        for (uint64_t i = 0; i < n; i++){
+            persist_func::clwb(line + i*CACHE_LINE_SIZE);
+        }
+        st.add(st.clwbs, n);
+    } else {
+        size_t sz = ral->malloc_size(addr);
+        persist_func::clwb_range_nofence(addr, sz);
+        // as many as clwb_range_nofence issues
+        st.add(st.clwbs, ((((uint64_t)addr + sz) | CACHE_LINE_MASK) - (uint64_t)addr)
+            / CACHE_LINE_SIZE + 1);
+    }
+}
+void BufferedWB::collect_lines(void* addr, std::vector<char*>& lines){
+    if (is_raw(addr)){
+        lines.push_back((char*)((uint64_t)unmark_raw(addr) & ~CACHE_LINE_MASK));
+    } else if (is_lines(addr)){
+        char* line = (char*)unmark_lines(addr);
+        for (uint64_t i = 0; i < lines_of(addr); i++){
+            lines.push_back(line + i*CACHE_LINE_SIZE);
+        }
     } else {
-        persist_func::clwb_range_nofence(
-            addr, ral->malloc_size(addr));
+        char* end = (char*)addr + ral->malloc_size(addr);
+        for (char* l = (char*)((uint64_t)addr & ~CACHE_LINE_MASK); l < end; l += CACHE_LINE_SIZE){
+            lines.push_back(l);
+        }
+    }
+}
+void BufferedWB::flush_lines(std::vector<char*>& lines){
+    if (lines.empty()){
+        return;
+    }
+    WBStats& st = local_stats();
+    std::sort(lines.begin(), lines.end());
+    lines.erase(std::unique(lines.begin(), lines.end()), lines.end());
+    uint64_t last_xpline = ~0ULL;
+    for (char* l : lines){
+        persist_func::clwb(l);
+        uint64_t xpline = (uint64_t)l / XPLINE_SIZE;
+        if (xpline != last_xpline){
+            st.add(st.xplines, 1);
+            last_xpline = xpline;
+        }
+    }
+    st.add(st.clwbs, lines.size());
+    st.add(st.flushes, 1);
+    lines.clear();
+}
+void BufferedWB::flush_local(uint64_t c, int tid){
+    if (sorted){
+        thread_local std::vector<char*> lines;
+        container->pop_all_local([&](void*& addr){collect_lines(addr, lines);}, tid, c);
+        flush_lines(lines);
+    } else {
+        bool flushed = false;
+        container->pop_all_local([&](void*& addr){do_persist(addr); flushed = true;}, tid, c);
+        if (flushed){
+            WBStats& st = local_stats();
+            st.add(st.flushes, 1);
+        }
+    }
+}
+void BufferedWB::evict(void*& addr){
+    if (!persister || !persister->hand_off(addr, EpochSys::tid)){
+        do_persist(addr);
     }
 }
 void BufferedWB::register_persist(PBlk* blk, uint64_t c){
@@ -179,27 +251,49 @@ void BufferedWB::register_persist(PBlk* blk, uint64_t c){
     if (c == NULL_EPOCH){
         errexit("registering persist of epoch NULL.");
     }
-    container->push(blk, [&](void*& addr){do_persist(addr);}, EpochSys::tid, c);
-    
+    container->push(blk, [&](void*& addr){evict(addr);}, EpochSys::tid, c);
+    count_registered(EpochSys::tid);
 }
 void BufferedWB::register_persist_raw(PBlk* blk, uint64_t c){
     assert(blk!=nullptr);
     if (c == NULL_EPOCH){
         errexit("registering persist of epoch NULL.");
     }
-    container->push(mark_raw(blk), [&](void*& addr){do_persist(addr);}, EpochSys::tid, c);
+    container->push(mark_raw(blk), [&](void*& addr){evict(addr);}, EpochSys::tid, c);
+    count_registered(EpochSys::tid);
+}
+void BufferedWB::register_persist_range(PBlk* blk, void* start, size_t sz, uint64_t c){
+    assert(blk!=nullptr && sz > 0);
+    if (c == NULL_EPOCH){
+        errexit("registering persist of epoch NULL.");
+    }
+    char* line = (char*)((uint64_t)start & ~CACHE_LINE_MASK);
+    char* end = (char*)start + sz;
+    while (line < end){
+        uint64_t n = std::min(LINE_RUN, (uint64_t)(end - line + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE);
+        container->push(mark_lines(line, n), [&](void*& addr){evict(addr);}, EpochSys::tid, c);
+        line += n*CACHE_LINE_SIZE;
+    }
+    count_registered(EpochSys::tid);
 }
 void BufferedWB::persist_epoch(uint64_t c){ // NOTE: this is not thread-safe.
     // for (int i = 0; i < task_num; i++){
     //     container->pop_all_local(&do_persist, i, c);
     // }
-    container->pop_all([&](void*& addr){do_persist(addr);}, c);
     for (int i = 0; i < task_num; i++){
+        flush_local(c, i);
+        if (persister){
+            persister->drain(i);
+        }
         do_persist_desc_local(c, i);
     }
 }
 void BufferedWB::persist_epoch_local(uint64_t c, int tid){
-    container->pop_all_local([&](void*& addr){do_persist(addr);}, tid, c);
+    flush_local(c, tid);
+    // blocks of c may still be queued for the persister.
+    if (persister){
+        persister->drain(tid);
+    }
     do_persist_desc_local(c, tid);
 }
 void BufferedWB::clear(){
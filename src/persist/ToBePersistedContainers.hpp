@@ -2,6 +2,7 @@
 #define TO_BE_PERSISTED_CONTAINERS_HPP
 
 #include <condition_variable>
+#include <mutex>
 #include <thread>
 #include <hwloc.h>
 #include <atomic>
@@ -36,17 +37,57 @@ public:
     int task_num = -1;
     padded<void*>* descs_p = nullptr;
     paddedAtomic<bool>* desc_persist_indicators[EPOCH_WINDOW];
+    // per-thread count of registered blocks, kept only for the
+    // adaptive epoch advancer (count_volume). Slot task_num is shared
+    // by non-worker threads.
+    bool count_volume = false;
+    paddedAtomic<uint64_t>* registered_cnt = nullptr;
+    // per-thread slot of tid in statistics like registered_cnt.
+    inline int stat_slot(int tid){
+        return (tid >= 0 && tid < task_num) ? tid : task_num;
+    }
+    inline void count_registered(int tid){
+        if (!count_volume){
+            return;
+        }
+        int slot = stat_slot(tid);
+        std::atomic<uint64_t>& cnt = registered_cnt[slot].ui;
+        if (slot == task_num){
+            cnt.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            // only this thread writes its own slot.
+            cnt.store(cnt.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+    }
+    // approximate total number of blocks registered since
+    // count_volume was set.
+    uint64_t registered(){
+        uint64_t ret = 0;
+        for (int i = 0; registered_cnt && i <= task_num; i++){
+            ret += registered_cnt[i].ui.load(std::memory_order_relaxed);
+        }
+        return ret;
+    }
     virtual void init_desc_local(void* addr, int tid);
     virtual void register_persist_desc_local(uint64_t c, int tid);
     virtual void do_persist_desc_local(uint64_t c, int tid);
     virtual void register_persist(PBlk* blk, uint64_t c) = 0;
     virtual void register_persist_raw(PBlk* blk, uint64_t c) = 0;
+    // register only the sz bytes at start, inside blk, whose header
+    // is already registered in epoch c. Whole blk by default.
+    virtual void register_persist_range(PBlk* blk, void* start, size_t sz, uint64_t c){
+        register_persist(blk, c);
+    }
     virtual void persist_epoch(uint64_t c) = 0;
     virtual void persist_epoch_local(uint64_t c, int tid) = 0;
     virtual void help_persist_external(uint64_t c) {}
     virtual void clear() = 0;
     ToBePersistContainer(Ralloc* r, int tn): ral(r), task_num(tn){
         descs_p = new padded<void*>[task_num];
+        registered_cnt = new paddedAtomic<uint64_t>[task_num+1];
+        for (int i = 0; i <= task_num; i++){
+            registered_cnt[i].ui.store(0);
+        }
         for (int i = 0; i < EPOCH_WINDOW; i++){
             desc_persist_indicators[i] = new paddedAtomic<bool>[task_num];
         }
@@ -61,6 +102,7 @@ public:
     virtual ~ToBePersistContainer() {
         if (task_num > 0){
             delete descs_p;
+            delete[] registered_cnt;
             for (int i = 0; i < EPOCH_WINDOW; i++){
                 delete desc_persist_indicators[i];
             }
@@ -83,73 +125,93 @@ public:
     void register_persist_raw(PBlk* blk, uint64_t c){
         persist_func::clwb(blk);
     }
+    void register_persist_range(PBlk* blk, void* start, size_t sz, uint64_t c){
+        persist_func::clwb_range_nofence(start, sz);
+    }
     void persist_epoch(uint64_t c){}
     void persist_epoch_local(uint64_t c, int tid){}
     void clear(){}
 };
 
 class BufferedWB : public ToBePersistContainer{
-    // class Persister{
-    // public:
-    //     BufferedWB* con = nullptr;
-    //     Persister(BufferedWB* _con) : con(_con){}
-    //     virtual ~Persister() {}
-    //     virtual void help_persist_local(uint64_t c) = 0;
-    // };
-
-    // class PerThreadDedicatedWait : public Persister{
-    //     struct Signal {
-    //         std::mutex bell;
-    //         std::condition_variable ring;
-    //         int curr = 0;
-    //         uint64_t epoch = INIT_EPOCH;
-    //     }__attribute__((aligned(CACHE_LINE_SIZE)));
-
-    //     GlobalTestConfig* gtc;
-    //     std::vector<std::thread> persisters;
-    //     std::vector<hwloc_obj_t> persister_affinities;
-    //     std::atomic<bool> exit;
-    //     Signal* signals;
-    //     // TODO: explain in comment what's going on here.
-    //     void persister_main(int worker_id);
-    // public:
-    //     PerThreadDedicatedWait(BufferedWB* _con, GlobalTestConfig* _gtc);
-    //     ~PerThreadDedicatedWait();
-    //     void help_persist_local(uint64_t c);
-    // };
-
-    // class PerThreadDedicatedBusy : public Persister{
-    //     struct Signal {
-    //         std::atomic<int> curr;
-    //         std::atomic<int> ack;
-    //         uint64_t epoch = INIT_EPOCH;
-    //     }__attribute__((aligned(CACHE_LINE_SIZE)));
-
-    //     GlobalTestConfig* gtc;
-    //     std::vector<std::thread> persisters;
-    //     std::vector<hwloc_obj_t> persister_affinities;
-    //     std::atomic<bool> exit;
-    //     Signal* signals;
-    //     // TODO: explain in comment what's going on here.
-    //     void persister_main(int worker_id);
-    // public:
-    //     PerThreadDedicatedBusy(BufferedWB* _con, GlobalTestConfig* _gtc);
-    //     ~PerThreadDedicatedBusy();
-    //     void help_persist_local(uint64_t c);
-    // };
-
-    // class WorkerThreadPersister : public Persister{
-    // public:
-    //     WorkerThreadPersister(BufferedWB* _con) : Persister(_con) {}
-    //     void help_persist_local(uint64_t c);
-    // };
+    // Write-back helpers, one per worker, pinned to the hyperthread
+    // sibling of the worker (env Persister=PerThreadBusy or
+    // PerThreadWait). Blocks a worker evicts from its full buffer are
+    // handed to its helper through a bounded queue, and only written
+    // back inline when that queue is full too.
+    class PerThreadDedicated{
+        struct Handoff{
+            std::atomic<uint64_t> pushed; // by the worker
+            std::atomic<uint64_t> done; // by the persister, after a fence
+            std::atomic<bool> sleeping;
+            std::mutex bell;
+            std::condition_variable ring;
+            void** slots = nullptr;
+        }__attribute__((aligned(CACHE_LINE_SIZE)));
+
+        BufferedWB* con;
+        GlobalTestConfig* gtc;
+        bool busy; // spin instead of sleeping while idle
+        size_t cap;
+        std::vector<std::thread> persisters;
+        std::vector<hwloc_obj_t> persister_affinities;
+        std::atomic<bool> exit;
+        Handoff* handoffs;
+        void persister_main(int worker_id);
+    public:
+        PerThreadDedicated(BufferedWB* _con, GlobalTestConfig* _gtc, bool _busy, size_t _cap);
+        ~PerThreadDedicated();
+        // hand addr over from worker tid; false if tid isn't a worker
+        // or its queue is full.
+        bool hand_off(void* addr, int tid);
+        // wait until all worker tid has handed over is written back.
+        void drain(int tid);
+    };
+
+    // write-back counters of a thread. Slots are per worker and per
+    // persister; only the shared slot of other threads needs atomic
+    // increments.
+    struct WBStats{
+        std::atomic<uint64_t> clwbs{0};
+        std::atomic<uint64_t> xplines{0}; // only counted when sorted
+        std::atomic<uint64_t> flushes{0}; // epoch buffers written back
+        bool shared = false;
+        void add(std::atomic<uint64_t>& cnt, uint64_t n){
+            if (shared){
+                cnt.fetch_add(n, std::memory_order_relaxed);
+            } else {
+                cnt.store(cnt.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+            }
+        }
+    };
+    // size of the internal write unit of Optane DCPMM.
+    static const size_t XPLINE_SIZE = 256;
 
     // FixedCircBufferContainer<pds::pair>* container = nullptr;
     FixedContainer<void*>* container = nullptr;
     GlobalTestConfig* gtc;
-    // Persister* persister = nullptr;
+    PerThreadDedicated* persister = nullptr;
     int buffer_size = 64;
+    // write back each epoch buffer in address order, cache lines
+    // deduplicated, so that lines of one XPLine are written back
+    // together (env WriteBackOrder=Address).
+    bool sorted = false;
+    // task_num slots of workers, the shared one of other threads, and
+    // task_num of persisters.
+    padded<WBStats>* wb_stats = nullptr;
+    // the slot of the calling thread, other than a persister.
+    WBStats& local_stats();
     void do_persist(void*& addr);
+    void do_persist(void*& addr, WBStats& st);
+    // add the cache lines of the record addr to lines.
+    void collect_lines(void* addr, std::vector<char*>& lines);
+    // sort, dedup and write back lines, and clear it.
+    void flush_lines(std::vector<char*>& lines);
+    // write back the epoch c buffer of thread tid.
+    void flush_local(uint64_t c, int tid);
+    // write back a block evicted from a full buffer, through the
+    // persister if there is one.
+    void evict(void*& addr);
     // void dump(uint64_t c);
 public:
     BufferedWB (GlobalTestConfig* _gtc, Ralloc* r): 
@@ -159,7 +221,6 @@ public:
         } else {
             buffer_size = 64;
         }
-        // persister = new WorkerThreadPersister(this);
         if (gtc->checkEnv("Container")){
             std::string env_container = gtc->getEnv("Container");
             if (env_container == "CircBuffer"){
@@ -173,32 +234,46 @@ public:
             container = new FixedCircBufferContainer<void*>(task_num, buffer_size);
         }
         
-        // if (gtc->checkEnv("Persister")){
-        //     std::string env_persister = gtc->getEnv("Persister");
-        //     if (env_persister == "PerThreadBusy"){
-        //         persister = new PerThreadDedicatedBusy(this, gtc);
-        //     } else if (env_persister == "PerThreadWait"){
-        //         persister = new PerThreadDedicatedWait(this, gtc); 
-        //     } else 
-        //     if (env_persister == "Worker"){
-        //         persister = new WorkerThreadPersister(this);
-        //     } else {
-        //         errexit("unsupported persister type by BufferedWB");
-        //     }
-        // } else {
-        //     persister = new WorkerThreadPersister(this);
-        // }
-        
-    }
-    ~BufferedWB(){
-        delete container;
-        // delete persister;
+        if (gtc->checkEnv("WriteBackOrder")){
+            std::string env_order = gtc->getEnv("WriteBackOrder");
+            if (env_order == "Address"){
+                sorted = true;
+            } else if (env_order != "Registration"){
+                errexit("unsupported write-back order by BufferedWB");
+            }
+        }
+        wb_stats = new padded<WBStats>[2*task_num+1];
+        wb_stats[task_num].ui.shared = true;
+
+        if (gtc->checkEnv("Persister")){
+            std::string env_persister = gtc->getEnv("Persister");
+            size_t queue_size = 1024;
+            if (gtc->checkEnv("PersisterQueue")){
+                queue_size = stoull(gtc->getEnv("PersisterQueue"));
+            }
+            if (env_persister == "PerThreadBusy"){
+                persister = new PerThreadDedicated(this, gtc, true, queue_size);
+            } else if (env_persister == "PerThreadWait"){
+                persister = new PerThreadDedicated(this, gtc, false, queue_size);
+            } else if (env_persister != "Worker"){
+                errexit("unsupported persister type by BufferedWB");
+            }
+        }
     }
+    ~BufferedWB();
     inline void* mark_raw(void* ptr) {return (void*)((uint64_t)ptr | 0x1ULL);}
     inline bool is_raw(void* ptr) {return (((uint64_t)ptr & 0x1ULL) == 0x1ULL);}
     inline void* unmark_raw(void* ptr) {return (void*)((uint64_t)ptr & ~0x1ULL);}
+    // a run of up to LINE_RUN cache lines from a line-aligned start:
+    // bit 1 marks it, and bits 2-5 hold the number of lines minus 1.
+    static constexpr uint64_t LINE_RUN = 16;
+    inline void* mark_lines(void* line, uint64_t n) {return (void*)((uint64_t)line | 0x2ULL | ((n-1) << 2));}
+    inline bool is_lines(void* ptr) {return (((uint64_t)ptr & 0x3ULL) == 0x2ULL);}
+    inline void* unmark_lines(void* ptr) {return (void*)((uint64_t)ptr & ~CACHE_LINE_MASK);}
+    inline uint64_t lines_of(void* ptr) {return (((uint64_t)ptr & CACHE_LINE_MASK) >> 2) + 1;}
     void register_persist(PBlk* blk, uint64_t c);
     void register_persist_raw(PBlk* blk, uint64_t c);
+    void register_persist_range(PBlk* blk, void* start, size_t sz, uint64_t c);
     void persist_epoch(uint64_t c);
     void persist_epoch_local(uint64_t c, int tid);
     void clear();
@@ -0,0 +1,122 @@
+#include "EpochDomain.hpp"
+
+thread_local EpochDomain* EpochDomain::creating = nullptr;
+thread_local const std::string* EpochDomain::creating_root = nullptr;
+
+EpochDomain::EpochDomain(GlobalTestConfig* gtc): gtc(gtc){
+    pds::EpochSys::init_thread(0);
+    _esys = Recoverable::new_esys(gtc);
+    scope_epochs = new padded<uint64_t>[gtc->task_num];
+    for (int i = 0; i < gtc->task_num; i++){
+        scope_epochs[i].ui = NULL_EPOCH;
+    }
+    // sort what recovery finds by root as it streams in; members
+    // take their share when they attach.
+    recovered.resize(_esys->get_rec_thd());
+    pds::RecoverCallback sort_by_root = [this](pds::PBlk* blk, int rec_tid){
+        recovered[rec_tid][blk->get_root_tag()].push_back(blk);
+    };
+    _esys->init(&sort_by_root);
+    uint64_t untagged = 0;
+    for (auto& r : recovered){
+        auto itr = r.find(0);
+        if (itr != r.end()){
+            untagged += itr->second.size();
+        }
+    }
+    if (untagged != 0){
+        errexit("heap has payloads not owned by any root; was it written outside of an EpochDomain?");
+    }
+}
+
+EpochDomain::~EpochDomain(){
+    if (!attached.empty()){
+        errexit("EpochDomain deleted before its members.");
+    }
+    delete _esys;
+    delete[] scope_epochs;
+}
+
+void EpochDomain::begin_atomic(){
+    // nbEpochSys doesn't hold epochs back for ongoing ops, so the
+    // pinned epoch could become durable halfway through the scope.
+    if (gtc->getEnv("Liveness") != "Blocking"){
+        errexit("EpochDomain::AtomicScope requires blocking Liveness.");
+    }
+    uint64_t& pinned = scope_epochs[pds::EpochSys::tid].ui;
+    assert(pinned == NULL_EPOCH);
+    pinned = _esys->begin_held_transaction();
+}
+
+void EpochDomain::end_atomic(){
+    uint64_t& pinned = scope_epochs[pds::EpochSys::tid].ui;
+    assert(pinned != NULL_EPOCH);
+    _esys->end_held_transaction(pinned);
+    pinned = NULL_EPOCH;
+}
+
+uint32_t EpochDomain::attach(const std::string& name){
+    std::lock_guard<std::mutex> lk(lock);
+    uint32_t tag = _esys->get_root_tag(name);
+    if (!attached.insert(tag).second){
+        errexit(("root " + name + " is already attached to the domain.").c_str());
+    }
+    return tag;
+}
+
+void EpochDomain::detach(uint32_t tag){
+    std::lock_guard<std::mutex> lk(lock);
+    attached.erase(tag);
+}
+
+uint64_t EpochDomain::stream(uint32_t tag, const pds::RecoverCallback& cb){
+    int rec_thd = recovered.size();
+    std::vector<std::vector<pds::PBlk*>> parts(rec_thd);
+    uint64_t cnt = 0;
+    {
+        std::lock_guard<std::mutex> lk(lock);
+        for (int i = 0; i < rec_thd; i++){
+            auto itr = recovered[i].find(tag);
+            if (itr != recovered[i].end()){
+                parts[i].swap(itr->second);
+                recovered[i].erase(itr);
+                cnt += parts[i].size();
+            }
+        }
+    }
+    if (cnt == 0){
+        return 0;
+    }
+    std::vector<std::thread> workers;
+    for (int rec_tid = 0; rec_tid < rec_thd; rec_tid++){
+        workers.emplace_back([&, rec_tid](){
+            hwloc_set_cpubind(gtc->topology, gtc->affinities[rec_tid]->cpuset, HWLOC_CPUBIND_THREAD);
+            pds::EpochSys::init_thread(rec_tid);
+            for (pds::PBlk* blk : parts[rec_tid]){
+                cb(blk, rec_tid);
+            }
+        });
+    }
+    for (auto& w : workers){
+        w.join();
+    }
+    return cnt;
+}
+
+std::unordered_map<uint64_t, pds::PBlk*>* EpochDomain::collect(uint32_t tag){
+    std::unordered_map<uint64_t, pds::PBlk*>* ret = nullptr;
+    std::lock_guard<std::mutex> lk(lock);
+    for (auto& r : recovered){
+        auto itr = r.find(tag);
+        if (itr != r.end()){
+            if (!ret){
+                ret = new std::unordered_map<uint64_t, pds::PBlk*>();
+            }
+            for (pds::PBlk* blk : itr->second){
+                ret->insert({blk->get_id(), blk});
+            }
+            r.erase(itr);
+        }
+    }
+    return ret;
+}
@@ -0,0 +1,109 @@
+#ifndef EPOCH_DOMAIN_HPP
+#define EPOCH_DOMAIN_HPP
+
+#include "TestConfig.hpp"
+#include "EpochSys.hpp"
+#include "Recoverable.hpp"
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+// An epoch system (one heap, one epoch advancer and one sync())
+// shared by several Recoverables. Each member attaches under a name,
+// kept in the heap as a named root; its payloads are tagged with the
+// root, and on restart it gets back exactly the payloads recovered
+// under that name.
+//
+//     EpochDomain domain(gtc);
+//     auto* orders = domain.create<MontageHashTable<K,V>>("orders", gtc);
+//     auto* log = domain.create<MontageQueue<V>>("log", gtc);
+//     ...
+//     domain.sync(); // all members are durable up to here
+//     delete orders;
+//     delete log;   // members must go before the domain
+//
+// Members share the system mode, so create and delete them while no
+// member is running operations.
+//
+// An AtomicScope makes several ops, possibly on different members,
+// failure-atomic together:
+//
+//     {
+//         EpochDomain::AtomicScope scope(&domain);
+//         optional<V> job = work->dequeue(tid);
+//         if (job) results->put(key_of(*job), *job, tid);
+//     }
+class EpochDomain{
+    friend class Recoverable;
+
+    GlobalTestConfig* gtc = nullptr;
+    pds::EpochSys* _esys = nullptr;
+    std::mutex lock;
+    std::unordered_set<uint32_t> attached;
+    // epoch pinned by each thread's AtomicScope, or NULL_EPOCH.
+    padded<uint64_t>* scope_epochs = nullptr;
+    // payloads recovered on restart, per recovery thread and root
+    // tag, until the member with that root attaches and takes them.
+    std::vector<std::unordered_map<uint32_t, std::vector<pds::PBlk*>>> recovered;
+
+    // root for the Recoverable create() is constructing in this thread.
+    static thread_local EpochDomain* creating;
+    static thread_local const std::string* creating_root;
+
+    uint32_t attach(const std::string& name);
+    void detach(uint32_t tag);
+    // hand the recovered payloads of tag to cb, from the recovery
+    // thread that found each of them. Return their number.
+    uint64_t stream(uint32_t tag, const pds::RecoverCallback& cb);
+    // the recovered payloads of tag by id; nullptr if there's none.
+    std::unordered_map<uint64_t, pds::PBlk*>* collect(uint32_t tag);
+public:
+    EpochDomain(GlobalTestConfig* gtc);
+    ~EpochDomain();
+
+    // construct a T with args, attached to this domain under root
+    // name. Names are up to 31 characters and unique in the domain.
+    template<typename T, typename... Args>
+    T* create(const std::string& name, Args&&... args){
+        creating = this;
+        creating_root = &name;
+        T* ret = new T(std::forward<Args>(args)...);
+        if (creating != nullptr){
+            errexit("EpochDomain::create() only takes Recoverable types.");
+        }
+        return ret;
+    }
+
+    // Ops of this thread on any members between begin_atomic and
+    // end_atomic all run in one epoch, pinned for the whole scope, so
+    // they become durable together or not at all. Requires blocking
+    // Liveness. The epoch doesn't advance past the pinned one until
+    // the scope ends, so no other op can write a payload newer than
+    // those the scope reads; keep scopes short and never sync()
+    // inside one.
+    void begin_atomic();
+    void end_atomic();
+    class AtomicScope{
+        EpochDomain* domain = nullptr;
+    public:
+        AtomicScope(EpochDomain* domain_): domain(domain_){
+            domain->begin_atomic();
+        }
+        ~AtomicScope(){
+            domain->end_atomic();
+        }
+    };
+
+    // block until everything done in any member so far is durable.
+    void sync(){
+        _esys->sync();
+    }
+    pds::EpochSys* get_esys(){
+        return _esys;
+    }
+};
+
+#endif
@@ -1,8 +1,9 @@
 #include "Recoverable.hpp"
+#include "EpochDomain.hpp"
 #include "PersistFunc.hpp"
 // std::atomic<size_t> pds::abort_cnt(0);
 // std::atomic<size_t> pds::total_cnt(0);
-Recoverable::Recoverable(GlobalTestConfig* gtc){
+Recoverable::Recoverable(GlobalTestConfig* gtc, bool stream_recovery){
     // init Persistent allocator
     // TODO: put this into EpochSys.
     // Persistent::init();
@@ -10,35 +11,76 @@ Recoverable::Recoverable(GlobalTestConfig* gtc){
     for(int i = 0; i < gtc->task_num; i++){
         epochs[i].ui = NULL_EPOCH;
     }
+    batch_epochs = new padded<uint64_t>[gtc->task_num];
+    batching = new padded<bool>[gtc->task_num];
+    for(int i = 0; i < gtc->task_num; i++){
+        batch_epochs[i].ui = NULL_EPOCH;
+        batching[i].ui = false;
+    }
     pending_allocs = new padded<std::vector<pds::PBlk*>>[gtc->task_num];
     pending_retires = new padded<std::vector<pair<pds::PBlk*,pds::PBlk*>>>[gtc->task_num];
     // init main thread
     pds::EpochSys::init_thread(0);
-    // init epoch system
+    // init epoch system, or join the one of the domain creating us
+    if (EpochDomain::creating){
+        domain = EpochDomain::creating;
+        EpochDomain::creating = nullptr;
+        _esys = domain->_esys;
+        scope_epochs = domain->scope_epochs;
+        root_tag = domain->attach(*EpochDomain::creating_root);
+    } else {
+        _esys = new_esys(gtc);
+    }
+    if (!stream_recovery){
+        init_esys(nullptr);
+    }
+}
+pds::EpochSys* Recoverable::new_esys(GlobalTestConfig* gtc){
     if(gtc->checkEnv("Liveness")){
         string env_liveness = gtc->getEnv("Liveness");
         if(env_liveness == "Nonblocking"){
-            _esys = new pds::nbEpochSys(gtc);
+            return new pds::nbEpochSys(gtc);
         } else if (env_liveness == "Blocking"){
-            _esys = new pds::EpochSys(gtc);
+            return new pds::EpochSys(gtc);
         } else {
             errexit("unrecognized 'Liveness' environment");
         }
     } else {
         gtc->setEnv("Liveness", "Blocking");
-        _esys = new pds::EpochSys(gtc);
     }
-    _esys->init();
-    recovered_pblks = _esys->get_recovered();
-    if (recovered_pblks) {
-        last_recovered_cnt = recovered_pblks->size();
+    return new pds::EpochSys(gtc);
+}
+void Recoverable::init_esys(const pds::RecoverCallback* stream){
+    if (domain){
+        // the domain has recovered already; take our root's share.
+        if (stream){
+            last_recovered_cnt = domain->stream(root_tag, *stream);
+        } else {
+            recovered_pblks = domain->collect(root_tag);
+            last_recovered_cnt = recovered_pblks ? recovered_pblks->size() : 0;
+        }
+        return;
     }
+    _esys->init(stream);
+    recovered_pblks = _esys->get_recovered();
+    last_recovered_cnt = _esys->get_recovered_cnt();
+}
+int Recoverable::recover_stream(const pds::RecoverCallback& cb){
+    init_esys(&cb);
+    return last_recovered_cnt;
 }
 Recoverable::~Recoverable(){
-    delete _esys;
+    if (domain){
+        domain->detach(root_tag);
+        delete recovered_pblks;
+    } else {
+        delete _esys;
+    }
     delete pending_allocs;
     delete pending_retires;
     delete epochs;
+    delete[] batch_epochs;
+    delete[] batching;
     // Persistent::finalize();
 }
 void Recoverable::init_thread(GlobalTestConfig*, LocalTestConfig* ltc){
@@ -4,9 +4,15 @@
 #include "TestConfig.hpp"
 #include "EpochSys.hpp"
 #include <immintrin.h>
+#include <algorithm>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
 // TODO: report recover errors/exceptions
 
 class Recoverable;
+class EpochDomain;
 
 namespace pds{
     ////////////////////////////////////////
@@ -59,9 +65,19 @@ namespace pds{
 
 class Recoverable{
     pds::EpochSys* _esys = nullptr;
+    // shared epoch domain we are attached to, if any, and our root in it.
+    EpochDomain* domain = nullptr;
+    uint32_t root_tag = 0;
+    // epoch each thread's EpochDomain::AtomicScope pins, shared by
+    // all members of the domain.
+    padded<uint64_t>* scope_epochs = nullptr;
     
     // current epoch of each thread.
     padded<uint64_t>* epochs = nullptr;
+    // epoch each thread keeps registered across the ops of a batch,
+    // and whether it is in one.
+    padded<uint64_t>* batch_epochs = nullptr;
+    padded<bool>* batching = nullptr;
     // containers for pending allocations
     padded<std::vector<pds::PBlk*>>* pending_allocs = nullptr;
     // pending retires; each pair is <original payload, anti-payload>
@@ -70,15 +86,81 @@ class Recoverable{
     std::unordered_map<uint64_t, pds::PBlk *>* recovered_pblks = nullptr;
     // count of last recovered PBlks from EpochSys
     uint64_t last_recovered_cnt = 0;
+    // finish the epoch system initialization, including recovery.
+    void init_esys(const pds::RecoverCallback* stream);
 public:
+    // a new epoch system of the kind selected by env Liveness.
+    static pds::EpochSys* new_esys(GlobalTestConfig* gtc);
     // return num of blocks recovered.
     virtual int recover() {
         errexit("recover() not implemented. Implement recover() or delete existing persistent heap file.");
         return 0;
     }
-    Recoverable(GlobalTestConfig* gtc);
+    // If stream_recovery is true, initialization (and recovery, on
+    // restart) is deferred until recover_stream() is called by the
+    // rideable, which must be done before any operation.
+    // Constructed through EpochDomain::create(), it attaches to that
+    // domain's epoch system instead of starting its own.
+    Recoverable(GlobalTestConfig* gtc, bool stream_recovery = false);
     virtual ~Recoverable();
 
+    // on restart, hand every recovered PBlk to cb, called by recovery
+    // thread rec_tid for PBlks in the id shard it owns, in place of
+    // building get_recovered_pblks(). Recovery threads are pinned and
+    // init_thread'ed. Return num of blocks recovered.
+    int recover_stream(const pds::RecoverCallback& cb);
+    // number of recovery threads; rec_tid handed to recover_stream
+    // callbacks is below it.
+    int get_rec_thd(){
+        return _esys->get_rec_thd();
+    }
+    // on restart, gather recovered PBlks as <key_of(blk), blk> pairs
+    // sorted by key, for rideables that rebuild in order. key_of is
+    // called once per PBlk. Each recovery thread sorts what it is
+    // streamed, and the sorted runs are then merged pairwise in
+    // parallel.
+    template<typename T, typename KeyOf>
+    auto recover_sorted(KeyOf key_of)
+        -> std::vector<std::pair<std::decay_t<decltype(key_of((T*)nullptr))>, T*>>{
+        typedef std::pair<std::decay_t<decltype(key_of((T*)nullptr))>, T*> Entry;
+        auto less = [](const Entry& a, const Entry& b){
+            return a.first < b.first;
+        };
+        int rec_thd = get_rec_thd();
+        std::vector<padded<std::vector<Entry>>> runs(rec_thd);
+        recover_stream([&](pds::PBlk* blk, int rec_tid){
+            T* t = reinterpret_cast<T*>(blk);
+            runs[rec_tid].ui.emplace_back(key_of(t), t);
+        });
+        std::vector<std::thread> workers;
+        for (int i = 0; i < rec_thd; i++){
+            workers.emplace_back([&, i](){
+                std::sort(runs[i].ui.begin(), runs[i].ui.end(), less);
+            });
+        }
+        for (auto& w : workers){
+            w.join();
+        }
+        for (int step = 1; step < rec_thd; step *= 2){
+            workers.clear();
+            for (int i = 0; i + step < rec_thd; i += 2 * step){
+                workers.emplace_back([&, i, step](){
+                    std::vector<Entry> merged;
+                    merged.reserve(runs[i].ui.size() + runs[i + step].ui.size());
+                    std::merge(runs[i].ui.begin(), runs[i].ui.end(),
+                        runs[i + step].ui.begin(), runs[i + step].ui.end(),
+                        std::back_inserter(merged), less);
+                    runs[i].ui.swap(merged);
+                    std::vector<Entry>().swap(runs[i + step].ui);
+                });
+            }
+            for (auto& w : workers){
+                w.join();
+            }
+        }
+        return std::move(runs[0].ui);
+    }
+
     void init_thread(GlobalTestConfig*, LocalTestConfig* ltc);
     void init_thread(int tid);
     bool check_epoch(){
@@ -87,9 +169,36 @@ public:
     bool check_epoch(uint64_t c){
         return _esys->check_epoch(c);
     }
+    // the epoch for the next op of a batch: the held one while it is
+    // still current, otherwise a fresh transaction.
+    uint64_t batch_transaction(){
+        uint64_t& held = batch_epochs[pds::EpochSys::tid].ui;
+        if (held != NULL_EPOCH && _esys->check_epoch(held)){
+            _esys->continue_transaction(held);
+        } else {
+            if (held != NULL_EPOCH){
+                _esys->end_transaction(held);
+            }
+            held = _esys->begin_transaction();
+        }
+        return held;
+    }
+    // whether the transaction of the current op outlives it, i.e. the
+    // op is part of a batch or of an atomic scope.
+    bool transaction_held(){
+        return batching[pds::EpochSys::tid].ui || (scope_epochs &&
+            scope_epochs[pds::EpochSys::tid].ui != NULL_EPOCH);
+    }
     void begin_op(){
         assert(epochs[pds::EpochSys::tid].ui == NULL_EPOCH);
-        epochs[pds::EpochSys::tid].ui = _esys->begin_transaction();
+        if (scope_epochs && scope_epochs[pds::EpochSys::tid].ui != NULL_EPOCH){
+            assert(!batching[pds::EpochSys::tid].ui);
+            epochs[pds::EpochSys::tid].ui = scope_epochs[pds::EpochSys::tid].ui;
+            _esys->continue_transaction(epochs[pds::EpochSys::tid].ui);
+        } else {
+            epochs[pds::EpochSys::tid].ui = batching[pds::EpochSys::tid].ui ?
+                batch_transaction() : _esys->begin_transaction();
+        }
         for(auto & r : pending_retires[pds::EpochSys::tid].ui) {
             // for nonblocking, create anti-nodes for retires called
             // before begin_op, place anti-nodes into pending_retires,
@@ -118,7 +227,9 @@ public:
             pending_retires[pds::EpochSys::tid].ui.clear();
         }
         if (epochs[pds::EpochSys::tid].ui != NULL_EPOCH){
-            _esys->end_transaction(epochs[pds::EpochSys::tid].ui);
+            if (!transaction_held()){
+                _esys->end_transaction(epochs[pds::EpochSys::tid].ui);
+            }
             epochs[pds::EpochSys::tid].ui = NULL_EPOCH;
         }
         if(!pending_allocs[pds::EpochSys::tid].ui.empty()) 
@@ -127,7 +238,9 @@ public:
     void end_readonly_op(){
         assert(epochs[pds::EpochSys::tid].ui != NULL_EPOCH);
         if (epochs[pds::EpochSys::tid].ui != NULL_EPOCH){
-            _esys->end_readonly_transaction(epochs[pds::EpochSys::tid].ui);
+            if (!transaction_held()){
+                _esys->end_readonly_transaction(epochs[pds::EpochSys::tid].ui);
+            }
             epochs[pds::EpochSys::tid].ui = NULL_EPOCH;
         }
         assert(pending_allocs[pds::EpochSys::tid].ui.empty());
@@ -147,9 +260,30 @@ public:
             // reset epochs registered in pending blocks
             _esys->reset_alloc_pblk(*b,epochs[pds::EpochSys::tid].ui);
         }
-        _esys->abort_transaction(epochs[pds::EpochSys::tid].ui);
+        if (!transaction_held()){
+            _esys->abort_transaction(epochs[pds::EpochSys::tid].ui);
+        }
         epochs[pds::EpochSys::tid].ui = NULL_EPOCH;
     }
+    // Ops between begin_batch and end_batch keep one epoch registered
+    // and only re-register when the epoch has moved on, instead of a
+    // full begin/end_transaction each. Each op is still durable with
+    // the epoch it linearized in. The thread holds back epoch advance
+    // between ops, so keep batches short and never sync() inside one.
+    void begin_batch(){
+        assert(!batching[pds::EpochSys::tid].ui);
+        assert(epochs[pds::EpochSys::tid].ui == NULL_EPOCH);
+        batching[pds::EpochSys::tid].ui = true;
+    }
+    void end_batch(){
+        assert(batching[pds::EpochSys::tid].ui);
+        assert(epochs[pds::EpochSys::tid].ui == NULL_EPOCH);
+        batching[pds::EpochSys::tid].ui = false;
+        if (batch_epochs[pds::EpochSys::tid].ui != NULL_EPOCH){
+            _esys->end_transaction(batch_epochs[pds::EpochSys::tid].ui);
+            batch_epochs[pds::EpochSys::tid].ui = NULL_EPOCH;
+        }
+    }
     class MontageOpHolder{
         Recoverable* ds = nullptr;
     public:
@@ -160,6 +294,16 @@ public:
             ds->end_op();
         }
     };
+    class MontageBatchHolder{
+        Recoverable* ds = nullptr;
+    public:
+        MontageBatchHolder(Recoverable* ds_): ds(ds_){
+            ds->begin_batch();
+        }
+        ~MontageBatchHolder(){
+            ds->end_batch();
+        }
+    };
     class MontageOpHolderReadOnly{
         Recoverable* ds = nullptr;
     public:
@@ -173,6 +317,7 @@ public:
     pds::PBlk* pmalloc(size_t sz) 
     {
         pds::PBlk* ret = (pds::PBlk*)_esys->malloc_pblk(sz);
+        ret->set_root_tag(root_tag);
         if (epochs[pds::EpochSys::tid].ui == NULL_EPOCH){
             pending_allocs[pds::EpochSys::tid].ui.push_back(ret);
         } else {
@@ -184,6 +329,7 @@ public:
     T* pnew(Types... args) 
     {
         T* ret = _esys->new_pblk<T>(args...);
+        ret->set_root_tag(root_tag);
         if (epochs[pds::EpochSys::tid].ui == NULL_EPOCH){
             pending_allocs[pds::EpochSys::tid].ui.push_back(ret);
         } else {
@@ -196,6 +342,11 @@ public:
     void register_update_pblk(T* b){
         _esys->register_update_pblk(b, epochs[pds::EpochSys::tid].ui);
     }
+    // register an update of only the sz bytes at start in b.
+    template<typename T>
+    void register_update_pblk_range(T* b, const void* start, size_t sz){
+        _esys->register_update_pblk_range(b, const_cast<void*>(start), sz, epochs[pds::EpochSys::tid].ui);
+    }
     template<typename T>
     void pdelete(T* b){
         ASSERT_DERIVE(T, pds::PBlk);
@@ -291,6 +442,13 @@ public:
         assert(epochs[pds::EpochSys::tid].ui != NULL_EPOCH);
         return _esys->openwrite_pblk(b, epochs[pds::EpochSys::tid].ui);
     }
+    // like openwrite_pblk, but the copy is constructed from args, and
+    // sized for them, so that b can grow or shrink.
+    template<typename T, typename... Types>
+    T* reallocate_pblk(T* b, Types&&... args){
+        assert(epochs[pds::EpochSys::tid].ui != NULL_EPOCH);
+        return _esys->reallocate_pblk(b, epochs[pds::EpochSys::tid].ui, std::forward<Types>(args)...);
+    }
     std::unordered_map<uint64_t, pds::PBlk*>* get_recovered_pblks(){
         return recovered_pblks;
     }
@@ -313,6 +471,19 @@ public:
         }
         // _esys->flush();
     }
+    // whether a snapshot is expected at exit (env CleanExit=Snapshot).
+    // Never in a shared domain, as one member can't tell what the
+    // others have live.
+    bool snapshot_enabled(){
+        return domain == nullptr && _esys->snapshot_enabled();
+    }
+    // persist the given live payloads so that the next restart
+    // doesn't scan the heap. Call it single-threaded at the beginning
+    // of the destructor, before the transient index is torn down.
+    void write_snapshot(std::vector<pds::PBlk*>& live){
+        assert(epochs[pds::EpochSys::tid].ui == NULL_EPOCH);
+        _esys->write_snapshot(live);
+    }
 
     pds::sc_desc_t* get_dcss_desc(){
         return _esys->get_dcss_desc();
@@ -352,7 +523,13 @@ T* TOKEN_CONCAT(set_, n)(Recoverable* ds, const in_type& TOKEN_CONCAT(tmp_, n)){
     assert(ds->get_local_epoch() != NULL_EPOCH);\
     auto ret = ds->openwrite_pblk(this);\
     ret->TOKEN_CONCAT(m_, n) = TOKEN_CONCAT(tmp_, n);\
-    ds->register_update_pblk(ret);\
+    /* a block of this epoch is already registered in full, */\
+    /* when allocated or copied; only the field is dirty now. */\
+    if (ret == this){\
+        ds->register_update_pblk_range(ret, &ret->TOKEN_CONCAT(m_, n), sizeof(t));\
+    } else {\
+        ds->register_update_pblk(ret);\
+    }\
     return ret;\
 }\
 /* set the field by the parameter. called only outside BEGIN_OP and END_OP */\
@@ -382,7 +559,11 @@ T* TOKEN_CONCAT(set_, n)(Recoverable* ds, int i, t TOKEN_CONCAT(tmp_, n)){\
     assert(ds->get_local_epoch() != NULL_EPOCH);\
     auto ret = ds->openwrite_pblk(this);\
     ret->TOKEN_CONCAT(m_, n)[i] = TOKEN_CONCAT(tmp_, n);\
-    ds->register_update_pblk(ret);\
+    if (ret == this){\
+        ds->register_update_pblk_range(ret, &ret->TOKEN_CONCAT(m_, n)[i], sizeof(t));\
+    } else {\
+        ds->register_update_pblk(ret);\
+    }\
     return ret;\
 }
 
@@ -0,0 +1,138 @@
+#ifndef VAR_STRING_PBLK_HPP
+#define VAR_STRING_PBLK_HPP
+
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <initializer_list>
+#include "Recoverable.hpp"
+
+namespace pds{
+
+// Base of payloads T holding n strings, each stored at exactly its
+// own length, back to back right past the fixed part of T:
+//
+//     class Payload : public VarStringPBlk<Payload, 2>{
+//     public:
+//         using VarStringPBlk::size_of;
+//         Payload(const std::string& k, const std::string& v):
+//             VarStringPBlk({k, v}){}
+//         Payload(const Payload& oth, int i, std::string_view s):
+//             VarStringPBlk(oth, i, s){}
+//         static size_t size_of(const std::string& k, const std::string& v){
+//             return VarStringPBlk::size_of({k, v});
+//         }
+//     };
+//
+// pnew() allocates T::size_of(args...) bytes for T(args...), so T has
+// a size_of for each of its constructors; those of this class cover
+// the copies. A string written at another length reallocates the
+// block, which keeps its id.
+template<class T, int n>
+class VarStringPBlk : public PBlk{
+    uint32_t sizes[n];
+
+    char* tail(){
+        return (char*)static_cast<T*>(this) + sizeof(T);
+    }
+    const char* tail() const {
+        return (const char*)static_cast<const T*>(this) + sizeof(T);
+    }
+    // offset of the i-th string in the tail.
+    size_t offset(int i) const {
+        size_t ret = 0;
+        for (int j = 0; j < i; j++){
+            ret += sizes[j];
+        }
+        return ret;
+    }
+    std::string_view str(int i) const {
+        return std::string_view(tail() + offset(i), sizes[i]);
+    }
+protected:
+    VarStringPBlk(std::initializer_list<std::string_view> strs){
+        assert(strs.size() == n);
+        char* dst = tail();
+        int i = 0;
+        for (auto s : strs){
+            sizes[i++] = s.size();
+            memcpy(dst, s.data(), s.size());
+            dst += s.size();
+        }
+    }
+    VarStringPBlk(const VarStringPBlk& oth): PBlk(oth){
+        memcpy(sizes, oth.sizes, sizeof(sizes));
+        memcpy(tail(), oth.tail(), oth.tail_size());
+    }
+    // a copy of oth with its i-th string replaced by s.
+    VarStringPBlk(const VarStringPBlk& oth, int i, std::string_view s): PBlk(oth){
+        char* dst = tail();
+        for (int j = 0; j < n; j++){
+            std::string_view src = (j == i) ? s : oth.str(j);
+            sizes[j] = src.size();
+            memcpy(dst, src.data(), src.size());
+            dst += src.size();
+        }
+    }
+public:
+    static size_t size_of(std::initializer_list<std::string_view> strs){
+        size_t ret = sizeof(T);
+        for (auto s : strs){
+            ret += s.size();
+        }
+        return ret;
+    }
+    static size_t size_of(const T& oth){
+        return sizeof(T) + oth.tail_size();
+    }
+    static size_t size_of(const T& oth, int i, std::string_view s){
+        const VarStringPBlk& o = oth;
+        return sizeof(T) + o.tail_size() - o.sizes[i] + s.size();
+    }
+    size_t tail_size() const {
+        return offset(n);
+    }
+
+    // get the i-th string, opening the pblk for read.
+    std::string get_str(Recoverable* ds, int i) const {
+        const VarStringPBlk* r = ds->openread_pblk(static_cast<const T*>(this));
+        return std::string(r->str(i));
+    }
+    // get the i-th string. Allows old-see-new reads.
+    std::string get_unsafe_str(Recoverable* ds, int i) const {
+        const VarStringPBlk* r = ds->openread_pblk_unsafe(static_cast<const T*>(this));
+        return std::string(r->str(i));
+    }
+    // view the i-th string in place. Allows old-see-new reads; the
+    // caller keeps the pblk from changing while using the view.
+    std::string_view get_unsafe_view(Recoverable* ds, int i) const {
+        const VarStringPBlk* r = ds->openread_pblk_unsafe(static_cast<const T*>(this));
+        return r->str(i);
+    }
+    // set the i-th string, opening the pblk for write. Return a new
+    // copy when necessary, which is always the case if s is of
+    // another length than the string it replaces.
+    T* set_str(Recoverable* ds, int i, std::string_view s){
+        assert(ds->get_local_epoch() != NULL_EPOCH);
+        T* self = static_cast<T*>(this);
+        if (s.size() != sizes[i]){
+            T* ret = ds->reallocate_pblk(self, *self, i, s);
+            ds->register_update_pblk(ret);
+            return ret;
+        }
+        T* ret = ds->openwrite_pblk(self);
+        VarStringPBlk* w = ret;
+        char* dst = w->tail() + w->offset(i);
+        memcpy(dst, s.data(), s.size());
+        if (ret == self){
+            ds->register_update_pblk_range(ret, dst, s.size());
+        } else {
+            ds->register_update_pblk(ret);
+        }
+        return ret;
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,506 @@
+#ifndef MONTAGE_BPLUSTREE_HPP
+#define MONTAGE_BPLUSTREE_HPP
+
+#include "TestConfig.hpp"
+#include "ROrderedMap.hpp"
+#include "CustomTypes.hpp"
+#include "ConcurrentPrimitives.hpp"
+#include "Recoverable.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+
+// B+tree in DRAM over one Montage payload per key. Inner nodes and
+// leaves keep their keys in plain sorted arrays, so a descent is a
+// binary search per node and a scan walks linked leaves; NVM is read
+// only for the values handed out. Removes don't merge nodes, so no
+// node is freed before the tree is.
+//
+// Each node has a reader-writer latch, taken by lock coupling from the
+// root down. Reads and scans hold shared latches, a scan moving from
+// leaf to leaf along next. Updates first latch only the leaf for
+// writing; an insert into a full leaf starts over and latches for
+// writing every node a split could reach, releasing those above a
+// node with room.
+template<typename K, typename V>
+class MontageBPlusTree : public ROrderedMap<K,V>, public Recoverable{
+public:
+    class Payload : public pds::PBlk{
+        GENERATE_FIELD(K, key, Payload);
+        GENERATE_FIELD(V, val, Payload);
+    public:
+        Payload(){}
+        Payload(K x, V y): m_key(x), m_val(y){}
+        Payload(const Payload& oth): pds::PBlk(oth), m_key(oth.m_key), m_val(oth.m_val){}
+        void persist(){}
+    }__attribute__((aligned(CACHELINE_SIZE)));
+
+private:
+    static const int LEAF_CAP = 32;
+    static const int INNER_CAP = 32; // keys; one more child
+    // bulk builds fill nodes this far, to leave room for inserts.
+    static const int LEAF_FILL = LEAF_CAP * 3 / 4;
+    static const int INNER_FILL = INNER_CAP * 3 / 4;
+
+    struct Node{
+        bool leaf;
+        int count = 0; // keys
+        std::shared_mutex latch;
+        Node(bool l): leaf(l){}
+    };
+    struct Leaf : public Node{
+        K keys[LEAF_CAP];
+        Payload* payloads[LEAF_CAP];
+        Leaf* next = nullptr;
+        Leaf(): Node(true){}
+    };
+    struct Inner : public Node{
+        // children[i] holds keys in [keys[i-1], keys[i]).
+        K keys[INNER_CAP];
+        Node* children[INNER_CAP + 1];
+        Inner(): Node(false){}
+    };
+
+    GlobalTestConfig* gtc;
+    // only changed by a split of the root, which holds its latch.
+    std::atomic<Node*> root;
+
+    static int child_index(const Inner* in, const K& key){
+        return std::upper_bound(in->keys, in->keys + in->count, key) - in->keys;
+    }
+    // whether n can take one more key without splitting.
+    static bool has_room(const Node* n){
+        return n->count < (n->leaf ? LEAF_CAP : INNER_CAP);
+    }
+    // the current root, latched shared or, if exclusive, for writing.
+    Node* latch_root(bool exclusive){
+        while (true){
+            Node* n = root.load();
+            exclusive ? n->latch.lock() : n->latch.lock_shared();
+            if (n == root.load()){
+                return n;
+            }
+            exclusive ? n->latch.unlock() : n->latch.unlock_shared();
+        }
+    }
+    // leaf that may hold key, latched shared or, if exclusive, for
+    // writing; inner nodes are only latched shared on the way.
+    Leaf* latch_leaf(const K& key, bool exclusive){
+        Node* n = latch_root(false);
+        if (n->leaf && exclusive){
+            // the root is a leaf: latch it again, for writing.
+            n->latch.unlock_shared();
+            n = latch_root(true);
+            if (!n->leaf){
+                // it split meanwhile.
+                n->latch.unlock();
+                return latch_leaf(key, exclusive);
+            }
+        }
+        while (!n->leaf){
+            Inner* in = static_cast<Inner*>(n);
+            Node* c = in->children[child_index(in, key)];
+            (c->leaf && exclusive) ? c->latch.lock() : c->latch.lock_shared();
+            in->latch.unlock_shared();
+            n = c;
+        }
+        return static_cast<Leaf*>(n);
+    }
+    // leaf that may hold key, latched for writing together with every
+    // node above it that a split would reach; those are in locked, and
+    // the inner ones with the child indices taken in path.
+    Leaf* latch_path(const K& key, std::vector<Node*>& locked, std::vector<std::pair<Inner*, int>>& path){
+        Node* n = latch_root(true);
+        locked.push_back(n);
+        while (!n->leaf){
+            Inner* in = static_cast<Inner*>(n);
+            int idx = child_index(in, key);
+            Node* c = in->children[idx];
+            c->latch.lock();
+            if (has_room(c)){
+                // a split stops at c.
+                unlatch(locked);
+                path.clear();
+            } else {
+                path.emplace_back(in, idx);
+            }
+            locked.push_back(c);
+            n = c;
+        }
+        return static_cast<Leaf*>(n);
+    }
+    static void unlatch(std::vector<Node*>& locked){
+        for (Node* n : locked){
+            n->latch.unlock();
+        }
+        locked.clear();
+    }
+
+    // insert p for key unless key is in the tree; if it is,
+    // on_found(leaf, pos) runs instead, in the op. Returns whether p
+    // went in.
+    template<typename F>
+    bool insert_payload(const K& key, Payload* p, F on_found){
+        std::vector<std::pair<Inner*, int>> path;
+        Leaf* l = latch_leaf(key, true);
+        int pos = position(l, key);
+        bool found = pos < l->count && l->keys[pos] == key;
+        if (!found && !has_room(l)){
+            // the leaf splits; start over, latching what that reaches.
+            l->latch.unlock();
+            std::vector<Node*> locked;
+            l = latch_path(key, locked, path);
+            pos = position(l, key);
+            found = pos < l->count && l->keys[pos] == key;
+            {
+                MontageOpHolder _holder(this);
+                if (found){
+                    on_found(l, pos);
+                } else {
+                    insert_at(l, pos, key, p, path);
+                }
+            }
+            unlatch(locked);
+            return !found;
+        }
+        {
+            MontageOpHolder _holder(this);
+            if (found){
+                on_found(l, pos);
+            } else {
+                insert_at(l, pos, key, p, path);
+            }
+        }
+        l->latch.unlock();
+        return !found;
+    }
+
+    // visit keys from lo on, in order, while more(key) holds; the
+    // leaves are latched shared one after the other.
+    template<typename C>
+    size_t visit(const K& lo, C more, typename ROrderedMap<K,V>::Visitor& f){
+        size_t ret = 0;
+        Leaf* l = latch_leaf(lo, false);
+        int pos = position(l, lo);
+        while (true){
+            for (; pos < l->count; pos++){
+                if (!more(l->keys[pos], ret)){
+                    l->latch.unlock_shared();
+                    return ret;
+                }
+                f(l->keys[pos], (V)l->payloads[pos]->get_unsafe_val(this));
+                ret++;
+            }
+            Leaf* next = l->next;
+            if (next){
+                next->latch.lock_shared();
+            }
+            l->latch.unlock_shared();
+            if (!next){
+                return ret;
+            }
+            l = next;
+            pos = 0;
+        }
+    }
+    static int position(const Leaf* l, const K& key){
+        return std::lower_bound(l->keys, l->keys + l->count, key) - l->keys;
+    }
+
+    // put key at pos of leaf l, splitting nodes up the path as needed.
+    void insert_at(Leaf* l, int pos, const K& key, Payload* p, std::vector<std::pair<Inner*, int>>& path){
+        if (l->count < LEAF_CAP){
+            std::move_backward(l->keys + pos, l->keys + l->count, l->keys + l->count + 1);
+            std::move_backward(l->payloads + pos, l->payloads + l->count, l->payloads + l->count + 1);
+            l->keys[pos] = key;
+            l->payloads[pos] = p;
+            l->count++;
+            return;
+        }
+        // split: the upper half moves to a new right sibling.
+        Leaf* r = new Leaf();
+        int half = (LEAF_CAP + 1) / 2;
+        Leaf* dst = pos < half ? l : r;
+        std::move(l->keys + half, l->keys + LEAF_CAP, r->keys);
+        std::move(l->payloads + half, l->payloads + LEAF_CAP, r->payloads);
+        r->count = LEAF_CAP - half;
+        l->count = half;
+        r->next = l->next;
+        l->next = r;
+        if (dst == r){
+            pos -= half;
+        }
+        std::move_backward(dst->keys + pos, dst->keys + dst->count, dst->keys + dst->count + 1);
+        std::move_backward(dst->payloads + pos, dst->payloads + dst->count, dst->payloads + dst->count + 1);
+        dst->keys[pos] = key;
+        dst->payloads[pos] = p;
+        dst->count++;
+        insert_up(r->keys[0], r, path);
+    }
+
+    // link right, whose keys start at sep, after the child we took at
+    // the end of path, splitting inner nodes as needed.
+    void insert_up(K sep, Node* right, std::vector<std::pair<Inner*, int>>& path){
+        while (!path.empty()){
+            Inner* in = path.back().first;
+            int idx = path.back().second;
+            path.pop_back();
+            if (in->count < INNER_CAP){
+                std::move_backward(in->keys + idx, in->keys + in->count, in->keys + in->count + 1);
+                std::move_backward(in->children + idx + 1, in->children + in->count + 1, in->children + in->count + 2);
+                in->keys[idx] = sep;
+                in->children[idx + 1] = right;
+                in->count++;
+                return;
+            }
+            // split around the middle key, which moves up.
+            K keys[INNER_CAP + 1];
+            Node* children[INNER_CAP + 2];
+            std::move(in->keys, in->keys + idx, keys);
+            keys[idx] = sep;
+            std::move(in->keys + idx, in->keys + INNER_CAP, keys + idx + 1);
+            std::copy(in->children, in->children + idx + 1, children);
+            children[idx + 1] = right;
+            std::copy(in->children + idx + 1, in->children + INNER_CAP + 1, children + idx + 2);
+            int mid = (INNER_CAP + 1) / 2;
+            Inner* r = new Inner();
+            std::move(keys, keys + mid, in->keys);
+            std::copy(children, children + mid + 1, in->children);
+            in->count = mid;
+            std::move(keys + mid + 1, keys + INNER_CAP + 1, r->keys);
+            std::copy(children + mid + 1, children + INNER_CAP + 2, r->children);
+            r->count = INNER_CAP - mid;
+            sep = keys[mid];
+            right = r;
+        }
+        Inner* new_root = new Inner();
+        new_root->keys[0] = sep;
+        new_root->children[0] = root.load();
+        new_root->children[1] = right;
+        new_root->count = 1;
+        root.store(new_root);
+    }
+
+    static void delete_nodes(Node* n){
+        if (!n->leaf){
+            Inner* in = static_cast<Inner*>(n);
+            for (int i = 0; i <= in->count; i++){
+                delete_nodes(in->children[i]);
+            }
+            delete in;
+        } else {
+            delete static_cast<Leaf*>(n);
+        }
+    }
+
+    Leaf* first_leaf(){
+        Node* n = root.load();
+        while (!n->leaf){
+            n = static_cast<Inner*>(n)->children[0];
+        }
+        return static_cast<Leaf*>(n);
+    }
+
+    // replace the (empty) tree with one over items, sorted by key and
+    // unique. Leaves are filled by rec_thd threads in parallel.
+    void build(const std::vector<std::pair<K, Payload*>>& items){
+        size_t nleaves = (items.size() + LEAF_FILL - 1) / LEAF_FILL;
+        std::vector<Node*> level(nleaves);
+        std::vector<K> mins(nleaves);
+        size_t nthd = std::max((size_t)1, std::min((size_t)get_rec_thd(), nleaves));
+        std::vector<std::thread> workers;
+        for (size_t t = 0; t < nthd; t++){
+            workers.emplace_back([&, t](){
+                for (size_t i = nleaves * t / nthd; i < nleaves * (t + 1) / nthd; i++){
+                    Leaf* l = new Leaf();
+                    size_t end = std::min(items.size(), (i + 1) * LEAF_FILL);
+                    for (size_t j = i * LEAF_FILL; j < end; j++){
+                        l->keys[l->count] = items[j].first;
+                        l->payloads[l->count] = items[j].second;
+                        l->count++;
+                    }
+                    level[i] = l;
+                    mins[i] = l->keys[0];
+                }
+            });
+        }
+        for (auto& w : workers){
+            w.join();
+        }
+        for (size_t i = 0; i + 1 < nleaves; i++){
+            static_cast<Leaf*>(level[i])->next = static_cast<Leaf*>(level[i + 1]);
+        }
+        // inner levels, bottom up; they are few enough to build serially.
+        while (level.size() > 1){
+            std::vector<Node*> upper;
+            std::vector<K> upper_mins;
+            for (size_t i = 0; i < level.size(); i += INNER_FILL + 1){
+                Inner* in = new Inner();
+                size_t end = std::min(level.size(), i + INNER_FILL + 1);
+                in->children[0] = level[i];
+                for (size_t j = i + 1; j < end; j++){
+                    in->keys[in->count] = mins[j];
+                    in->children[in->count + 1] = level[j];
+                    in->count++;
+                }
+                upper.push_back(in);
+                upper_mins.push_back(mins[i]);
+            }
+            level.swap(upper);
+            mins.swap(upper_mins);
+        }
+        delete_nodes(root.load());
+        root.store(level[0]);
+    }
+
+public:
+    MontageBPlusTree(GlobalTestConfig* gtc_): Recoverable(gtc_, true), gtc(gtc_), root(new Leaf()){
+        recover();
+    }
+
+    ~MontageBPlusTree(){
+        snapshot();
+        // clear transient structures; payloads stay.
+        delete_nodes(root.load());
+    }
+
+    void init_thread(GlobalTestConfig* gtc, LocalTestConfig* ltc){
+        Recoverable::init_thread(gtc, ltc);
+    }
+
+    optional<V> get(K key, int tid){
+        Leaf* l = latch_leaf(key, false);
+        std::shared_lock<std::shared_mutex> lk(l->latch, std::adopt_lock);
+        int pos = position(l, key);
+        if (pos < l->count && l->keys[pos] == key){
+            return (V)l->payloads[pos]->get_unsafe_val(this);
+        }
+        return {};
+    }
+
+    optional<V> put(K key, V val, int tid){
+        Payload* p = pnew<Payload>(key, val);
+        optional<V> ret = {};
+        insert_payload(key, p, [&](Leaf* l, int pos){
+            ret = (V)l->payloads[pos]->get_unsafe_val(this);
+            l->payloads[pos] = l->payloads[pos]->set_val(this, val);
+            pdelete(p);
+        });
+        return ret;
+    }
+
+    bool insert(K key, V val, int tid){
+        Payload* p = pnew<Payload>(key, val);
+        return insert_payload(key, p, [&](Leaf* l, int pos){
+            pdelete(p);
+        });
+    }
+
+    optional<V> replace(K key, V val, int tid){
+        Leaf* l = latch_leaf(key, true);
+        std::unique_lock<std::shared_mutex> lk(l->latch, std::adopt_lock);
+        MontageOpHolder _holder(this);
+        int pos = position(l, key);
+        if (pos < l->count && l->keys[pos] == key){
+            optional<V> ret = (V)l->payloads[pos]->get_unsafe_val(this);
+            l->payloads[pos] = l->payloads[pos]->set_val(this, val);
+            return ret;
+        }
+        return {};
+    }
+
+    optional<V> remove(K key, int tid){
+        Leaf* l = latch_leaf(key, true);
+        std::unique_lock<std::shared_mutex> lk(l->latch, std::adopt_lock);
+        MontageOpHolder _holder(this);
+        int pos = position(l, key);
+        if (pos < l->count && l->keys[pos] == key){
+            Payload* p = l->payloads[pos];
+            optional<V> ret = (V)p->get_unsafe_val(this);
+            std::move(l->keys + pos + 1, l->keys + l->count, l->keys + pos);
+            std::move(l->payloads + pos + 1, l->payloads + l->count, l->payloads + pos);
+            l->count--;
+            pdelete(p);
+            return ret;
+        }
+        return {};
+    }
+
+    // f runs under the read latch of a leaf, so it must not call into
+    // the tree.
+    size_t range(const K& lo, const K& hi, typename ROrderedMap<K,V>::Visitor f, int tid){
+        return visit(lo, [&](const K& k, size_t){return k < hi;}, f);
+    }
+
+    // Same rules for f as in range().
+    size_t scan(const K& lo, size_t n, typename ROrderedMap<K,V>::Visitor f, int tid){
+        return visit(lo, [&](const K&, size_t visited){return visited < n;}, f);
+    }
+
+    // record all payloads in the tree, if snapshot is enabled, so
+    // that restart from this exit needn't scan the heap.
+    void snapshot(){
+        if (!snapshot_enabled()){
+            return;
+        }
+        std::vector<pds::PBlk*> live;
+        for (Leaf* l = first_leaf(); l; l = l->next){
+            live.insert(live.end(), l->payloads, l->payloads + l->count);
+        }
+        write_snapshot(live);
+    }
+
+    int recover(){
+        auto begin = chrono::high_resolution_clock::now();
+        auto recovered = recover_sorted<Payload>([this](Payload* p){
+            return (K)p->get_unsafe_key(this);
+        });
+        for (size_t i = 1; i < recovered.size(); i++){
+            if (recovered[i].first == recovered[i-1].first){
+                errexit("conflicting keys recovered.");
+            }
+        }
+        if (recovered.empty()){
+            return 0;
+        }
+        build(recovered);
+        auto end = chrono::high_resolution_clock::now();
+        auto dur_ms = std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count();
+        std::cout << "Spent " << dur_ms << "ms building(" << recovered.size() << ")" << std::endl;
+        return recovered.size();
+    }
+};
+
+template <class T>
+class MontageBPlusTreeFactory : public RideableFactory{
+    Rideable* build(GlobalTestConfig* gtc){
+        return new MontageBPlusTree<T,T>(gtc);
+    }
+};
+
+/* Specialization for strings: key and val are sized exactly */
+#include <string>
+#include "VarStringPBlk.hpp"
+template <>
+class MontageBPlusTree<std::string, std::string>::Payload :
+    public pds::VarStringPBlk<MontageBPlusTree<std::string, std::string>::Payload, 2>{
+public:
+    using VarStringPBlk::size_of;
+    Payload(const std::string& k, const std::string& v) : VarStringPBlk({k, v}){}
+    Payload(const Payload& oth, int i, std::string_view s) : VarStringPBlk(oth, i, s){}
+    static size_t size_of(const std::string& k, const std::string& v){
+        return VarStringPBlk::size_of({k, v});
+    }
+    std::string get_key(Recoverable* ds) const {return get_str(ds, 0);}
+    std::string get_unsafe_key(Recoverable* ds) const {return get_unsafe_str(ds, 0);}
+    std::string get_val(Recoverable* ds) const {return get_str(ds, 1);}
+    std::string get_unsafe_val(Recoverable* ds) const {return get_unsafe_str(ds, 1);}
+    Payload* set_val(Recoverable* ds, const std::string& v){return set_str(ds, 1, v);}
+    void persist(){}
+};
+
+#endif
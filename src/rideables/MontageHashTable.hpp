@@ -3,14 +3,55 @@
 
 #include "TestConfig.hpp"
 #include "RMap.hpp"
+#include "ReadGuard.hpp"
 #include "CustomTypes.hpp"
 #include "ConcurrentPrimitives.hpp"
 #include "Recoverable.hpp"
+#include <atomic>
+#include <cstring>
 #include <mutex>
+#include <string>
+#include <type_traits>
+#include <vector>
 #include <omp.h>
 
+// DRAM copy of a key in a transient node, for keys short enough to
+// fit, so that a hash match needn't read the key from NVM either.
+// match() says whether k is the key: 1 or 0, or -1 if not cached.
+template<typename K, typename = void>
+struct ShortKeyCache{
+    void set(const K& k){}
+    int match(const K& k) const {return -1;}
+};
+template<typename K>
+struct ShortKeyCache<K, typename std::enable_if<std::is_arithmetic<K>::value>::type>{
+    K key;
+    void set(const K& k){key = k;}
+    int match(const K& k) const {return key == k;}
+};
+template<>
+struct ShortKeyCache<std::string>{
+    static const size_t CAP = 31;
+    uint8_t len = CAP + 1; // > CAP: not cached
+    char buf[CAP];
+    void set(const std::string& k){
+        if (k.size() <= CAP){
+            len = k.size();
+            memcpy(buf, k.data(), len);
+        } else {
+            len = CAP + 1;
+        }
+    }
+    int match(const std::string& k) const {
+        if (len > CAP){
+            return -1;
+        }
+        return len == k.size() && memcmp(buf, k.data(), len) == 0;
+    }
+};
+
 template<typename K, typename V, size_t idxSize=1000000>
-class MontageHashTable : public RMap<K,V>, public Recoverable{
+class MontageHashTable : public RMap<K,V>, public Recoverable, public Reportable{
 public:
 
     class Payload : public pds::PBlk{
@@ -29,11 +70,20 @@ public:
         Payload* payload = nullptr;
         // Transient-to-transient pointers
         ListNode* next = nullptr;
+        // hash of the key, by which chains are sorted, and the key
+        // itself if short, so that walking a chain stays in DRAM.
+        size_t hash = 0;
+        ShortKeyCache<K> key_cache;
         ListNode(){}
-        ListNode(MontageHashTable* ds_, K key, V val): ds(ds_){
+        ListNode(MontageHashTable* ds_, K key, V val): ds(ds_), hash(ds_->hash_fn(key)){
             payload = ds->pnew<Payload>(key, val);
+            key_cache.set(key);
+        }
+        ListNode(MontageHashTable* ds_, Payload* _payload) : ds(ds_), payload(_payload) { // for recovery
+            K key = get_key();
+            hash = ds->hash_fn(key);
+            key_cache.set(key);
         }
-        ListNode(MontageHashTable* ds_, Payload* _payload) : ds(ds_), payload(_payload) {} // for recovery
         K get_key(){
             assert(payload!=nullptr && "payload shouldn't be null");
             // old-see-new never happens for locking ds
@@ -56,41 +106,256 @@ public:
     struct Bucket{
         std::mutex lock;
         ListNode head;
+        // set once the chain has been moved to the next table.
+        bool migrated = false;
         Bucket():head(){};
     }__attribute__((aligned(CACHELINE_SIZE)));
+    struct Table{
+        size_t size;
+        Bucket* buckets;
+        // the table this one is being rehashed into, if any.
+        std::atomic<Table*> next;
+        // buckets handed out to and finished by rehashing threads.
+        std::atomic<size_t> claimed;
+        std::atomic<size_t> migrated;
+        Table(size_t sz): size(sz), buckets(new Bucket[sz]), next(nullptr), claimed(0), migrated(0){}
+        ~Table(){
+            delete[] buckets;
+        }
+    };
+    // number of buckets a writer rehashes before each operation.
+    static const size_t REHASH_STEP = 16;
 
     std::hash<K> hash_fn;
-    Bucket buckets[idxSize];
     GlobalTestConfig* gtc;
-    MontageHashTable(GlobalTestConfig* gtc_): Recoverable(gtc_), gtc(gtc_){
-        if (get_recovered_pblks()) {
-            recover();
+    // grow when the table holds more than load_factor keys per
+    // bucket on average. 0 means a fixed table of idxSize buckets.
+    double load_factor = 0;
+    // the oldest table with buckets not yet rehashed.
+    std::atomic<Table*> table;
+    // fully rehashed tables. Late readers may still be walking them,
+    // so they are kept till destruction.
+    std::vector<Table*> retired;
+    std::atomic<bool> resizing;
+    std::atomic<bool> grow;
+    std::vector<paddedAtomic<int64_t>> counts;
+    // per thread: keys read from NVM while walking chains, and nodes
+    // passed over on their hash or cached key alone.
+    std::vector<padded<uint64_t>> key_reads;
+    std::vector<padded<uint64_t>> key_reads_saved;
+
+    // With resizable set, the table starts with HashInitSize (1024
+    // by default) buckets and doubles once LoadFactor (1.0 by
+    // default) is exceeded.
+    MontageHashTable(GlobalTestConfig* gtc_, bool resizable = false):
+        Recoverable(gtc_, true), gtc(gtc_), resizing(false), grow(false), counts(gtc_->task_num),
+        key_reads(gtc_->task_num), key_reads_saved(gtc_->task_num){
+        size_t init_size = idxSize;
+        if (resizable){
+            init_size = 1024;
+            load_factor = 1.0;
+            if (gtc->checkEnv("HashInitSize")){
+                init_size = stoull(gtc->getEnv("HashInitSize"));
+            }
+            if (gtc->checkEnv("LoadFactor")){
+                load_factor = stod(gtc->getEnv("LoadFactor"));
+            }
+            if (init_size == 0 || load_factor <= 0){
+                errexit("HashInitSize and LoadFactor must be positive.");
+            }
         }
+        table.store(new Table(init_size));
+        recover();
     };
 
     ~MontageHashTable() {
+        snapshot();
         recover_mode(); // PDELETE --> noop
         // clear transient structures.
         clear();
         online_mode(); // re-enable PDELETE.
+        for (Table* t = table.load(); t != nullptr; ){
+            Table* next = t->next.load();
+            delete t;
+            t = next;
+        }
+        for (Table* t : retired){
+            delete t;
+        }
     }
 
     void init_thread(GlobalTestConfig* gtc, LocalTestConfig* ltc){
         Recoverable::init_thread(gtc, ltc);
     }
 
+    void introduce(){
+        gtc->recorder->addGlobalField("key_nvm_reads");
+        gtc->recorder->addGlobalField("key_nvm_reads_saved");
+    }
+    void conclude(){
+        uint64_t reads = 0, saved = 0;
+        for (int i = 0; i < gtc->task_num; i++){
+            reads += key_reads[i].ui;
+            saved += key_reads_saved[i].ui;
+        }
+        gtc->recorder->reportGlobalInfo("key_nvm_reads", (unsigned long)reads);
+        gtc->recorder->reportGlobalInfo("key_nvm_reads_saved", (unsigned long)saved);
+    }
+
+    // lock and return the bucket holding keys of hash h. A bucket
+    // that was rehashed sends us to the next table.
+    Bucket* lock_bucket(size_t h){
+        Table* t = table.load();
+        while(true){
+            Bucket* b = &t->buckets[h % t->size];
+            b->lock.lock();
+            if (!b->migrated){
+                return b;
+            }
+            b->lock.unlock();
+            t = t->next.load();
+        }
+    }
+
+    int64_t key_count(){
+        int64_t ret = 0;
+        for (auto& c : counts){
+            ret += c.ui.load(std::memory_order_relaxed);
+        }
+        return ret;
+    }
+
+    // account for an added (d=1) or removed (d=-1) key, and every
+    // now and then check whether the table should grow.
+    void count_key(int tid, int64_t d){
+        if (load_factor <= 0){
+            return;
+        }
+        int64_t old = counts[tid % counts.size()].ui.fetch_add(d, std::memory_order_relaxed);
+        if (d > 0 && (old & 63) == 0 &&
+            key_count() > load_factor * table.load()->size){
+            grow.store(true);
+        }
+    }
+
+    // called by writers before taking any lock: start a pending
+    // resize, and rehash a few buckets of the one in progress.
+    void maintain(){
+        if (load_factor <= 0){
+            return;
+        }
+        if (grow.load()){
+            start_resize();
+        }
+        Table* t = table.load();
+        Table* n = t->next.load();
+        if (n == nullptr){
+            return;
+        }
+        for (size_t i = 0; i < REHASH_STEP; i++){
+            size_t idx = t->claimed.fetch_add(1);
+            if (idx >= t->size){
+                return;
+            }
+            rehash_bucket(t, n, idx);
+            if (t->migrated.fetch_add(1) + 1 == t->size){
+                // we finished the last bucket.
+                retired.push_back(t);
+                table.store(n);
+                resizing.store(false);
+                return;
+            }
+        }
+    }
+
+    void start_resize(){
+        bool expected = false;
+        if (!resizing.compare_exchange_strong(expected, true)){
+            return;
+        }
+        grow.store(false);
+        Table* t = table.load();
+        if (key_count() > load_factor * t->size){
+            t->next.store(new Table(t->size * 2));
+        } else {
+            resizing.store(false);
+        }
+    }
+
+    // find key, of hash h, in the chain of bucket, which is sorted by
+    // hash. Return its node, or nullptr with prev set to the node to
+    // link it after. Keys are read from NVM only for nodes of hash h
+    // without a cached key. tid < 0 (recovery) isn't counted.
+    ListNode* find(Bucket* bucket, const K& key, size_t h, ListNode*& prev, int tid){
+        ListNode* ret = nullptr;
+        uint64_t looked = 0, reads = 0;
+        prev = &bucket->head;
+        for (ListNode* curr = prev->next; curr; prev = curr, curr = curr->next){
+            looked++;
+            if (curr->hash > h){
+                break;
+            } else if (curr->hash < h){
+                continue;
+            }
+            int m = curr->key_cache.match(key);
+            if (m < 0){
+                reads++;
+                m = (curr->get_key() == key);
+            }
+            if (m){
+                ret = curr;
+                break;
+            }
+        }
+        if (tid >= 0){
+            key_reads[tid].ui += reads;
+            key_reads_saved[tid].ui += looked - reads;
+        }
+        return ret;
+    }
+
+    // move the chain of bucket idx of t to buckets idx and
+    // idx+t->size of n. Chains stay sorted, and payloads are not
+    // touched.
+    void rehash_bucket(Table* t, Table* n, size_t idx){
+        Bucket& b = t->buckets[idx];
+        Bucket& lo = n->buckets[idx];
+        Bucket& hi = n->buckets[idx + t->size];
+        // always lock the older table first.
+        std::lock_guard<std::mutex> lk(b.lock);
+        std::lock_guard<std::mutex> lk_lo(lo.lock);
+        std::lock_guard<std::mutex> lk_hi(hi.lock);
+        ListNode* lo_tail = &lo.head;
+        ListNode* hi_tail = &hi.head;
+        ListNode* curr = b.head.next;
+        while(curr){
+            ListNode* next = curr->next;
+            if (curr->hash % n->size == idx){
+                lo_tail->next = curr;
+                lo_tail = curr;
+            } else {
+                hi_tail->next = curr;
+                hi_tail = curr;
+            }
+            curr = next;
+        }
+        lo_tail->next = nullptr;
+        hi_tail->next = nullptr;
+        b.head.next = nullptr;
+        b.migrated = true;
+    }
+
     optional<V> get(K key, int tid){
-        size_t idx=hash_fn(key)%idxSize;
         // while(true){
-        std::lock_guard<std::mutex> lk(buckets[idx].lock);
+        size_t h = hash_fn(key);
+        Bucket* bucket = lock_bucket(h);
+        std::lock_guard<std::mutex> lk(bucket->lock, std::adopt_lock);
         MontageOpHolderReadOnly(this);
             // try{
-        ListNode* curr = buckets[idx].head.next;
-        while(curr){
-            if (curr->get_key() == key){
-                return curr->get_val();
-            }
-            curr = curr->next;
+        ListNode* prev = nullptr;
+        ListNode* curr = find(bucket, key, h, prev, tid);
+        if (curr){
+            return curr->get_val();
         }
         return {};
             // } catch(OldSeeNewException& e){
@@ -99,32 +364,49 @@ public:
         // }
     }
 
+    // zero-copy get for string values; see ReadGuard. The guard holds
+    // the bucket lock, which every writer of the payload takes.
+    bool has_view(){
+        return std::is_same<V, std::string>::value;
+    }
+    ReadGuard get_view(K key, int tid){
+        if constexpr (!std::is_same<V, std::string>::value){
+            return ReadGuard();
+        } else {
+            size_t h = hash_fn(key);
+            Bucket* bucket = lock_bucket(h);
+            ReadGuard ret(&unlock_view, this, bucket, tid);
+            ListNode* prev = nullptr;
+            ListNode* curr = find(bucket, key, h, prev, tid);
+            if (curr){
+                ret.set(curr->payload->get_unsafe_val_view(this));
+            }
+            return ret;
+        }
+    }
+    static void unlock_view(void* ds, void* bucket, int tid){
+        ((Bucket*)bucket)->lock.unlock();
+    }
+
     optional<V> put(K key, V val, int tid){
-        size_t idx=hash_fn(key)%idxSize;
+        maintain();
         ListNode* new_node = new ListNode(this, key, val);
         // while(true){
-        std::lock_guard<std::mutex> lk(buckets[idx].lock);
+        Bucket* bucket = lock_bucket(new_node->hash);
+        std::lock_guard<std::mutex> lk(bucket->lock, std::adopt_lock);
         MontageOpHolder _holder(this);
         // try{
-        ListNode* curr = buckets[idx].head.next;
-        ListNode* prev = &buckets[idx].head;
-        while(curr){
-            K curr_key = curr->get_key();
-            if (curr_key == key){
-                optional<V> ret = curr->get_val();
-                curr->set_val(val);
-                delete new_node;
-                return ret;
-            } else if (curr_key > key){
-                new_node->next = curr;
-                prev->next = new_node;
-                return {};
-            } else {
-                prev = curr;
-                curr = curr->next;
-            }
+        ListNode* prev = nullptr;
+        ListNode* curr = find(bucket, key, new_node->hash, prev, tid);
+        if (curr){
+            optional<V> ret = curr->get_val();
+            curr->set_val(val);
+            delete new_node;
+            return ret;
         }
+        new_node->next = prev->next;
         prev->next = new_node;
+        count_key(tid, 1);
         return {};
         //     } catch (OldSeeNewException& e){
         //         continue;
@@ -133,29 +415,21 @@ public:
     }
 
     bool insert(K key, V val, int tid){
-        size_t idx=hash_fn(key)%idxSize;
+        maintain();
         ListNode* new_node = new ListNode(this, key, val);
         // while(true){
-        std::lock_guard<std::mutex> lk(buckets[idx].lock);
+        Bucket* bucket = lock_bucket(new_node->hash);
+        std::lock_guard<std::mutex> lk(bucket->lock, std::adopt_lock);
         MontageOpHolder _holder(this);
         // try{
-        ListNode* curr = buckets[idx].head.next;
-        ListNode* prev = &buckets[idx].head;
-        while(curr){
-            K curr_key = curr->get_key();
-            if (curr_key == key){
-                delete new_node;
-                return false;
-            } else if (curr_key > key){
-                new_node->next = curr;
-                prev->next = new_node;
-                return true;
-            } else {
-                prev = curr;
-                curr = curr->next;
-            }
+        ListNode* prev = nullptr;
+        if (find(bucket, key, new_node->hash, prev, tid)){
+            delete new_node;
+            return false;
         }
+        new_node->next = prev->next;
         prev->next = new_node;
+        count_key(tid, 1);
         return true;
         //     } catch (OldSeeNewException& e){
         //         continue;
@@ -168,27 +442,34 @@ public:
         return {};
     }
 
+    // the ops of a batch share one epoch registration until the
+    // epoch moves on.
+    std::vector<optional<V>> put_batch(const std::vector<std::pair<K,V>>& kvs, int tid){
+        MontageBatchHolder _batch(this);
+        return RMap<K,V>::put_batch(kvs, tid);
+    }
+
+    std::vector<optional<V>> get_batch(const std::vector<K>& keys, int tid){
+        MontageBatchHolder _batch(this);
+        return RMap<K,V>::get_batch(keys, tid);
+    }
+
     optional<V> remove(K key, int tid){
-        size_t idx=hash_fn(key)%idxSize;
+        maintain();
         // while(true){
-        std::lock_guard<std::mutex> lk(buckets[idx].lock);
+        size_t h = hash_fn(key);
+        Bucket* bucket = lock_bucket(h);
+        std::lock_guard<std::mutex> lk(bucket->lock, std::adopt_lock);
         MontageOpHolder _holder(this);
         // try{
-        ListNode* curr = buckets[idx].head.next;
-        ListNode* prev = &buckets[idx].head;
-        while(curr){
-            K curr_key = curr->get_key();
-            if (curr_key == key){
-                optional<V> ret = curr->get_val();
-                prev->next = curr->next;
-                delete(curr);
-                return ret;
-            } else if (curr_key > key){
-                return {};
-            } else {
-                prev = curr;
-                curr = curr->next;
-            }
+        ListNode* prev = nullptr;
+        ListNode* curr = find(bucket, key, h, prev, tid);
+        if (curr){
+            optional<V> ret = curr->get_val();
+            prev->next = curr->next;
+            delete(curr);
+            count_key(tid, -1);
+            return ret;
         }
         return {};
         //     } catch (OldSeeNewException& e){
@@ -197,105 +478,104 @@ public:
         // }
     }
 
+    // apply f to every bucket that may hold keys. Not thread-safe.
+    template<typename F>
+    void for_each_bucket(F f){
+        for (Table* t = table.load(); t != nullptr; t = t->next.load()){
+            for (uint64_t i = 0; i < t->size; i++){
+                if (!t->buckets[i].migrated){
+                    f(t->buckets[i]);
+                }
+            }
+        }
+    }
+
     void clear(){
-        for (uint64_t i = 0; i < idxSize; i++){
-            ListNode* curr = buckets[i].head.next;
+        for_each_bucket([](Bucket& b){
+            ListNode* curr = b.head.next;
             ListNode* next = nullptr;
             while(curr){
                 next = curr->next;
                 delete curr;
                 curr = next;
             }
-            buckets[i].head.next = nullptr;
+            b.head.next = nullptr;
+        });
+        for (auto& c : counts){
+            c.ui.store(0);
         }
     }
 
 
-    int recover(){
-        std::unordered_map<uint64_t, pds::PBlk*>* recovered = get_recovered_pblks();
-        assert(recovered);
-
-        int rec_cnt = 0;
-        int rec_thd = gtc->task_num;
-        if (gtc->checkEnv("RecoverThread")){
-            rec_thd = stoi(gtc->getEnv("RecoverThread"));
-        }
-        std::vector<Payload*> payloadVector;
-        payloadVector.reserve(recovered->size());
-        auto begin = chrono::high_resolution_clock::now();
-        for (auto itr = recovered->begin(); itr != recovered->end(); itr++){
-            rec_cnt++;
-            Payload* payload = reinterpret_cast<Payload*>(itr->second);
-                        payloadVector.push_back(payload);
-        }
-        auto end = chrono::high_resolution_clock::now();
-        auto dur = end - begin;
-        auto dur_ms_vec = std::chrono::duration_cast<std::chrono::milliseconds>(dur).count();
-        std::cout << "Spent " << dur_ms_vec << "ms building vector" << std::endl;
-        begin = chrono::high_resolution_clock::now();
-        std::vector<std::thread> workers;
-        for (int rec_tid = 0; rec_tid < rec_thd; rec_tid++) {
-            workers.emplace_back(std::thread([&, rec_tid]() {
-                Recoverable::init_thread(rec_tid);
-                hwloc_set_cpubind(gtc->topology,
-                                  gtc->affinities[rec_tid]->cpuset,
-                                  HWLOC_CPUBIND_THREAD);
-                for (size_t i = rec_tid; i < payloadVector.size(); i += rec_thd){
-                    //re-insert payload.
-                    ListNode* new_node = new ListNode(this, payloadVector[i]);
-                    K key = new_node->get_key();
-                    size_t idx = hash_fn(key) % idxSize;
-                    std::lock_guard<std::mutex> lk(buckets[idx].lock);
-                    ListNode* curr = buckets[idx].head.next;
-                    ListNode* prev = &buckets[idx].head;
-                    while (curr) {
-                        K curr_key = curr->get_key();
-                        if (curr_key == key) {
-                            errexit("conflicting keys recovered.");
-                        } else if (curr_key > key) {
-                            new_node->next = curr;
-                            prev->next = new_node;
-                            break;
-                        } else {
-                            prev = curr;
-                            curr = curr->next;
-                        }
-                    }
-                    prev->next = new_node;
-                }
-            }));  // workers.emplace_back()
-        }// for (rec_thd)
-        for (auto& worker : workers) {
-            if (worker.joinable()) {
-                worker.join();
+    // record all payloads in the table, if snapshot is enabled, so
+    // that restart from this exit needn't scan the heap.
+    void snapshot(){
+        if (!snapshot_enabled()){
+            return;
+        }
+        std::vector<pds::PBlk*> live;
+        for_each_bucket([&](Bucket& b){
+            for (ListNode* curr = b.head.next; curr; curr = curr->next){
+                live.push_back(curr->payload);
             }
+        });
+        write_snapshot(live);
+    }
+
+    // re-link a recovered payload. Thread-safe.
+    void reinsert(Payload* payload, int rec_tid){
+        maintain();
+        ListNode* new_node = new ListNode(this, payload);
+        K key = new_node->get_key();
+        Bucket* bucket = lock_bucket(new_node->hash);
+        std::lock_guard<std::mutex> lk(bucket->lock, std::adopt_lock);
+        ListNode* prev = nullptr;
+        if (find(bucket, key, new_node->hash, prev, -1)) {
+            errexit("conflicting keys recovered.");
         }
-        end = chrono::high_resolution_clock::now();
-        dur = end - begin;
-        auto dur_ms_ins = std::chrono::duration_cast<std::chrono::milliseconds>(dur).count();
-        std::cout << "Spent " << dur_ms_ins << "ms inserting(" << recovered->size() << ")" << std::endl;
-        return rec_cnt;
+        new_node->next = prev->next;
+        prev->next = new_node;
+        count_key(rec_tid, 1);
+    }
+
+    int recover(){
+        // payloads are streamed to us by the recovery threads of
+        // EpochSys as soon as they are known to survive.
+        return recover_stream([this](pds::PBlk* blk, int rec_tid){
+            reinsert(reinterpret_cast<Payload*>(blk), rec_tid);
+        });
     }
 };
 
 template <class T> 
 class MontageHashTableFactory : public RideableFactory{
+    bool resizable;
+public:
+    MontageHashTableFactory(bool resizable_ = false): resizable(resizable_){}
     Rideable* build(GlobalTestConfig* gtc){
-        return new MontageHashTable<T,T>(gtc);
+        return new MontageHashTable<T,T>(gtc, resizable);
     }
 };
 
-/* Specialization for strings */
+/* Specialization for strings: key and val are sized exactly */
 #include <string>
-#include "InPlaceString.hpp"
+#include "VarStringPBlk.hpp"
 template <>
-class MontageHashTable<std::string, std::string, 1000000>::Payload : public pds::PBlk{
-    GENERATE_FIELD(pds::InPlaceString<TESTS_KEY_SIZE>, key, Payload);
-    GENERATE_FIELD(pds::InPlaceString<TESTS_VAL_SIZE>, val, Payload);
-
+class MontageHashTable<std::string, std::string, 1000000>::Payload :
+    public pds::VarStringPBlk<MontageHashTable<std::string, std::string, 1000000>::Payload, 2>{
 public:
-    Payload(const std::string& k, const std::string& v) : m_key(this, k), m_val(this, v){}
-    Payload(const Payload& oth) : pds::PBlk(oth), m_key(this, oth.m_key), m_val(this, oth.m_val){}
+    using VarStringPBlk::size_of;
+    Payload(const std::string& k, const std::string& v) : VarStringPBlk({k, v}){}
+    Payload(const Payload& oth, int i, std::string_view s) : VarStringPBlk(oth, i, s){}
+    static size_t size_of(const std::string& k, const std::string& v){
+        return VarStringPBlk::size_of({k, v});
+    }
+    std::string get_key(Recoverable* ds) const {return get_str(ds, 0);}
+    std::string get_unsafe_key(Recoverable* ds) const {return get_unsafe_str(ds, 0);}
+    std::string get_val(Recoverable* ds) const {return get_str(ds, 1);}
+    std::string get_unsafe_val(Recoverable* ds) const {return get_unsafe_str(ds, 1);}
+    std::string_view get_unsafe_val_view(Recoverable* ds) const {return get_unsafe_view(ds, 1);}
+    Payload* set_val(Recoverable* ds, const std::string& v){return set_str(ds, 1, v);}
     void persist(){}
 };
 
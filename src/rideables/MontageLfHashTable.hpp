@@ -11,14 +11,21 @@
 #include <functional>
 #include <vector>
 #include <utility>
+#include <type_traits>
 
 #include "HarnessUtils.hpp"
 #include "ConcurrentPrimitives.hpp"
 #include "RMap.hpp"
+#include "ReadGuard.hpp"
 #include "RCUTracker.hpp"
 #include "CustomTypes.hpp"
 #include "Recoverable.hpp"
 
+// Split-ordered list (Shalev and Shavit): all nodes sit in one Harris
+// list sorted by the bit-reversed hash, and bucket i points to a dummy
+// node at the start of its range. Doubling the bucket count splits
+// each range in two without moving any node, so the table grows
+// online and lock-free. idxSize is the initial number of buckets.
 template <class K, class V, int idxSize=1000000>
 class MontageLfHashTable : public RMap<K,V>, public Recoverable{
 public:
@@ -45,12 +52,16 @@ private:
         MarkPtr next;
         Payload* payload;// TODO: does it have to be atomic?
         K key;
+        // split-order key: odd for regular nodes, even for dummies.
+        uint64_t so_key;
         Node(MontageLfHashTable* ds_, K k, V v, Node* n):
-            ds(ds_),next(n),key(k){
+            ds(ds_),next(n),key(k),so_key(so_regular(ds_->hash_fn(k))){
             payload = ds->pnew<Payload>(k,v);
             // assert(ds->epochs[pds::EpochSys::tid].ui == NULL_EPOCH);
             };
-        Node(MontageLfHashTable* ds_, Payload* _payload) : ds(ds_), payload(_payload),key(_payload->get_unsafe_key(ds)) {} // for recovery
+        Node(MontageLfHashTable* ds_, Payload* _payload) : ds(ds_), payload(_payload),key(_payload->get_unsafe_key(ds)),
+            so_key(so_regular(ds_->hash_fn(key))) {} // for recovery
+        Node(MontageLfHashTable* ds_, uint64_t so) : ds(ds_), next(nullptr), payload(nullptr), key(), so_key(so) {} // dummy
         K get_key(){
             return key;
         }
@@ -74,8 +85,22 @@ private:
         }
     }__attribute__((aligned(CACHELINE_SIZE)));
     std::hash<K> hash_fn;
-    padded<MarkPtr>* buckets=new padded<MarkPtr>[idxSize]{};
+    // bucket directory: segment 0 holds bucket 0, and segment s>0
+    // holds buckets [2^(s-1), 2^s). Segments are allocated on first
+    // touch, and a bucket's dummy is linked on first use.
+    std::atomic<std::atomic<Node*>*> segments[64];
+    size_t init_size = 1;
+    std::atomic<size_t> size;
+    // grow when the table holds more than load_factor keys per
+    // bucket on average.
+    double load_factor = 1.0;
+    std::vector<paddedAtomic<int64_t>> counts;
     bool findNode(MarkPtr* &prev, Node* &curr, Node* &next, K key, int tid);
+    bool search(MarkPtr* start, uint64_t so, const K& key, MarkPtr* &prev, Node* &curr, Node* &next, int tid);
+    Node* getBucket(size_t b, int tid);
+    std::atomic<Node*>& bucketSlot(size_t b);
+    void count_key(int tid, int64_t d);
+    static void end_view(void* ds, void* arg, int tid);
 
     RCUTracker tracker;
     GlobalTestConfig* gtc;
@@ -93,17 +118,65 @@ private:
     inline Node* setMark(Node* d){
         return reinterpret_cast<Node*>((uint64_t)d | 1);
     }
+    static inline uint64_t reverse_bits(uint64_t x){
+        x = ((x >> 1) & 0x5555555555555555ULL) | ((x & 0x5555555555555555ULL) << 1);
+        x = ((x >> 2) & 0x3333333333333333ULL) | ((x & 0x3333333333333333ULL) << 2);
+        x = ((x >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((x & 0x0F0F0F0F0F0F0F0FULL) << 4);
+        return __builtin_bswap64(x);
+    }
+    static inline uint64_t so_regular(uint64_t h){
+        return reverse_bits(h) | 1;
+    }
+    static inline uint64_t so_dummy(uint64_t b){
+        return reverse_bits(b);
+    }
+    // compare node n against (so, key): <0, 0 or >0. Keys are only
+    // compared between regular nodes of the same hash.
+    inline int compare(Node* n, uint64_t so, const K& key){
+        if (n->so_key != so){
+            return n->so_key < so ? -1 : 1;
+        }
+        if (!(so & 1) || n->key == key){
+            return 0;
+        }
+        return n->key < key ? -1 : 1;
+    }
+    Node* head(){
+        return bucketSlot(0).load();
+    }
 public:
-    MontageLfHashTable(GlobalTestConfig* gtc) : Recoverable(gtc), tracker(gtc->task_num, 100, 1000, true), gtc(gtc) {
-        if (get_recovered_pblks()) {
-            recover();
+    // HashInitSize and LoadFactor override the initial bucket count
+    // and the growth threshold.
+    MontageLfHashTable(GlobalTestConfig* gtc) : Recoverable(gtc, true), counts(gtc->task_num),
+        tracker(gtc->task_num, 100, 1000, true), gtc(gtc) {
+        size_t want = idxSize;
+        if (gtc->checkEnv("HashInitSize")){
+            want = stoull(gtc->getEnv("HashInitSize"));
+        }
+        if (gtc->checkEnv("LoadFactor")){
+            load_factor = stod(gtc->getEnv("LoadFactor"));
+        }
+        if (load_factor <= 0){
+            errexit("LoadFactor must be positive.");
+        }
+        while (init_size < want){
+            init_size *= 2;
         }
+        size.store(init_size);
+        for (auto& seg : segments){
+            seg.store(nullptr);
+        }
+        bucketSlot(0).store(new Node(this, so_dummy(0)));
+        recover();
     };
     ~MontageLfHashTable(){
+        snapshot();
         recover_mode(); // PDELETE --> noop
         // clear transient structures.
         clear();
         online_mode(); // re-enable PDELETE.
+        delete head();
+        delete[] segments[0].load();
     };
 
     void init_thread(GlobalTestConfig* gtc, LocalTestConfig* ltc){
@@ -111,88 +184,85 @@ public:
     }
     void clear(){
         //single-threaded; for recovery test only
-        for (uint64_t i = 0; i < idxSize; i++){
-            Node* curr = buckets[i].ui.ptr.load(this);
-            Node* next = nullptr;
-            while(curr){
-                next = curr->next.ptr.load(this);
-                delete curr;
-                curr = next;
+        Node* curr = getPtr(head()->next.ptr.load(this));
+        Node* next = nullptr;
+        while(curr){
+            next = getPtr(curr->next.ptr.load(this));
+            delete curr;
+            curr = next;
+        }
+        head()->next.ptr.store(this,nullptr);
+        // dummies are gone, so drop every bucket but 0.
+        for (int s = 1; s < 64; s++){
+            delete[] segments[s].load();
+            segments[s].store(nullptr);
+        }
+        size.store(init_size);
+        for (auto& c : counts){
+            c.ui.store(0);
+        }
+    }
+    // record all unmarked payloads, if snapshot is enabled, so that
+    // restart from this exit needn't scan the heap. Retired nodes are
+    // reclaimed first, as nothing outside the snapshot survives.
+    void snapshot(){
+        if (!snapshot_enabled()){
+            return;
+        }
+        tracker.empty_all();
+        std::vector<pds::PBlk*> live;
+        Node* curr = getPtr(head()->next.ptr.load(this));
+        while(curr){
+            Node* next = curr->next.ptr.load(this);
+            if (curr->payload && !getMark(next)){
+                live.push_back(curr->payload);
             }
-            buckets[i].ui.ptr.store(this,nullptr);
+            curr = getPtr(next);
         }
+        write_snapshot(live);
     }
-    int recover(){
-        int rec_cnt = 0;
-        int rec_thd = gtc->task_num;
-        if (gtc->checkEnv("RecoverThread")){
-            rec_thd = stoi(gtc->getEnv("RecoverThread"));
-        }
-        std::unordered_map<uint64_t, pds::PBlk*>* recovered = get_recovered_pblks(); 
-        assert(recovered);
-
-        std::vector<Payload*> payloadVector;
-        payloadVector.reserve(recovered->size());
-        auto begin = chrono::high_resolution_clock::now();
-        for (auto itr = recovered->begin(); itr != recovered->end(); itr++){
-            rec_cnt++;
-            Payload* payload = reinterpret_cast<Payload*>(itr->second);
-            payloadVector.push_back(payload);
-        }
-        auto end = chrono::high_resolution_clock::now();
-        auto dur = end - begin;
-        auto dur_ms_vec = std::chrono::duration_cast<std::chrono::milliseconds>(dur).count();
-        std::cout << "Spent " << dur_ms_vec << "ms building vector" << std::endl;
-        begin = chrono::high_resolution_clock::now();
-        std::vector<std::thread> workers;
-        for (int rec_tid = 0; rec_tid < rec_thd; rec_tid++) {
-            workers.emplace_back(std::thread([&, rec_tid]() {
-                Recoverable::init_thread(rec_tid);
-                hwloc_set_cpubind(gtc->topology,
-                                  gtc->affinities[rec_tid]->cpuset,
-                                  HWLOC_CPUBIND_THREAD);
-                for (size_t i = rec_tid; i < payloadVector.size(); i += rec_thd) {
-                    // re-insert payload.
-                    Node* tmpNode = new Node(this, payloadVector[i]);
-                    K key = tmpNode->get_key();
-                    size_t idx = hash_fn(key) % idxSize;
-                    MarkPtr* prev = nullptr;
-                    Node* curr;
-                    Node* next;
-                    while (true) {
-                        if (findNode(prev, curr, next, key, rec_tid)) {
-                            errexit("conflicting keys recovered.");
-                        } else {
-                            // does not exist, insert.
-                            tmpNode->next.ptr.store(this, curr);
-                            // begin_op();
-                            if (prev->ptr.CAS(this,curr, tmpNode)) {
-                                // end_op();
-                                break;
-                            }
-                            // abort_op();
-                        }
-                    }
-                }
-            }));  // workers.emplace_back()
-        }// for (rec_thd)
-        for (auto& worker : workers) {
-                if (worker.joinable()) {
-                    worker.join();
+    // re-link a recovered payload. Thread-safe.
+    void reinsert(Payload* payload, int tid){
+        Node* tmpNode = new Node(this, payload);
+        K key = tmpNode->get_key();
+        MarkPtr* prev = nullptr;
+        Node* curr;
+        Node* next;
+        while (true) {
+            if (findNode(prev, curr, next, key, tid)) {
+                errexit("conflicting keys recovered.");
+            } else {
+                // does not exist, insert.
+                tmpNode->next.ptr.store(this, curr);
+                if (prev->ptr.CAS(this,curr, tmpNode)) {
+                    break;
                 }
+            }
         }
-        end = chrono::high_resolution_clock::now();
-        dur = end - begin;
-        auto dur_ms_ins = std::chrono::duration_cast<std::chrono::milliseconds>(dur).count();
-        std::cout << "Spent " << dur_ms_ins << "ms inserting(" << recovered->size() << ")" << std::endl;
-        return rec_cnt;
+        count_key(tid, 1);
+    }
+    int recover(){
+        // payloads are streamed to us by the recovery threads of
+        // EpochSys as soon as they are known to survive.
+        return recover_stream([this](pds::PBlk* blk, int rec_tid){
+            reinsert(reinterpret_cast<Payload*>(blk), rec_tid);
+        });
     }
 
     optional<V> get(K key, int tid);
+    // zero-copy get for string values; see ReadGuard. The guard holds
+    // the tracker reservation, so the node and its payload, which is
+    // never written in place, stay put.
+    bool has_view(){
+        return std::is_same<V, std::string>::value;
+    }
+    ReadGuard get_view(K key, int tid);
     optional<V> put(K key, V val, int tid);
     bool insert(K key, V val, int tid);
     optional<V> remove(K key, int tid);
     optional<V> replace(K key, V val, int tid);
+    std::vector<optional<V>> put_batch(const std::vector<std::pair<K,V>>& kvs, int tid);
+    std::vector<optional<V>> get_batch(const std::vector<K>& keys, int tid);
 };
 
 template <class T> 
@@ -222,6 +292,29 @@ optional<V> MontageLfHashTable<K,V,idxSize>::get(K key, int tid) {
     return res;
 }
 
+template <class K, class V, int idxSize> 
+ReadGuard MontageLfHashTable<K,V,idxSize>::get_view(K key, int tid) {
+    if constexpr (!std::is_same<V, std::string>::value) {
+        return ReadGuard();
+    } else {
+        MarkPtr* prev=nullptr;
+        Node* curr;
+        Node* next;
+
+        tracker.start_op(tid);
+        ReadGuard res(&end_view, this, nullptr, tid);
+        if(findNode(prev,curr,next,key,tid)) {
+            res.set(curr->payload->get_unsafe_val_view(this));
+        }
+        return res;
+    }
+}
+
+template <class K, class V, int idxSize> 
+void MontageLfHashTable<K,V,idxSize>::end_view(void* ds, void* arg, int tid) {
+    ((MontageLfHashTable*)ds)->tracker.end_op(tid);
+}
+
 template <class K, class V, int idxSize> 
 optional<V> MontageLfHashTable<K,V,idxSize>::put(K key, V val, int tid) {
     optional<V> res={};
@@ -258,6 +351,7 @@ optional<V> MontageLfHashTable<K,V,idxSize>::put(K key, V val, int tid) {
             // begin_op();
             if(prev->ptr.CAS_verify(this,curr,tmpNode)) {
                 // end_op();
+                count_key(tid, 1);
                 break;
             }
             // abort_op();
@@ -268,6 +362,36 @@ optional<V> MontageLfHashTable<K,V,idxSize>::put(K key, V val, int tid) {
     return res;
 }
 
+// the CAS_verify of each put begins its op in the batch's epoch
+// while that is still current, instead of a transaction of its own.
+template <class K, class V, int idxSize> 
+std::vector<optional<V>> MontageLfHashTable<K,V,idxSize>::put_batch(const std::vector<std::pair<K,V>>& kvs, int tid) {
+    MontageBatchHolder _batch(this);
+    return RMap<K,V>::put_batch(kvs, tid);
+}
+
+// gets take no epoch, so batch them under one tracker op instead.
+template <class K, class V, int idxSize> 
+std::vector<optional<V>> MontageLfHashTable<K,V,idxSize>::get_batch(const std::vector<K>& keys, int tid) {
+    std::vector<optional<V>> ret;
+    ret.reserve(keys.size());
+    MarkPtr* prev=nullptr;
+    Node* curr;
+    Node* next;
+
+    tracker.start_op(tid);
+    for (const K& key : keys) {
+        if(findNode(prev,curr,next,key,tid)) {
+            ret.push_back(curr->get_unsafe_val());
+        } else {
+            ret.push_back({});
+        }
+    }
+    tracker.end_op(tid);
+
+    return ret;
+}
+
 template <class K, class V, int idxSize> 
 bool MontageLfHashTable<K,V,idxSize>::insert(K key, V val, int tid){
     bool res=false;
@@ -291,6 +415,7 @@ bool MontageLfHashTable<K,V,idxSize>::insert(K key, V val, int tid){
             if(prev->ptr.CAS_verify(this,curr,tmpNode)) {
                 // end_op();
                 res=true;
+                count_key(tid, 1);
                 break;
             }
             // abort_op();
@@ -322,6 +447,7 @@ optional<V> MontageLfHashTable<K,V,idxSize>::remove(K key, int tid) {
             continue;
         }
         // end_op();
+        count_key(tid, -1);
         if(prev->ptr.CAS(this,curr,next)) {
             tracker.retire(curr,tid);
         } else {
@@ -374,10 +500,16 @@ optional<V> MontageLfHashTable<K,V,idxSize>::replace(K key, V val, int tid) {
 
 template <class K, class V, int idxSize> 
 bool MontageLfHashTable<K,V,idxSize>::findNode(MarkPtr* &prev, Node* &curr, Node* &next, K key, int tid){
-    size_t idx=hash_fn(key)%idxSize;
+    size_t h=hash_fn(key);
+    Node* dummy=getBucket(h&(size.load()-1),tid);
+    return search(&dummy->next,so_regular(h),key,prev,curr,next,tid);
+}
+
+template <class K, class V, int idxSize> 
+bool MontageLfHashTable<K,V,idxSize>::search(MarkPtr* start, uint64_t so, const K& key, MarkPtr* &prev, Node* &curr, Node* &next, int tid){
     while(true){
         bool cmark=false;
-        prev=&buckets[idx].ui;
+        prev=start;
         curr=getPtr(prev->ptr.load(this));
 
         while(true){
@@ -385,10 +517,10 @@ bool MontageLfHashTable<K,V,idxSize>::findNode(MarkPtr* &prev, Node* &curr, Node
             next=curr->next.ptr.load(this);
             cmark=getMark(next);
             next=getPtr(next);
-            auto ckey=curr->get_key();
             if(prev->ptr.load(this)!=curr) break;//retry
             if(!cmark) {
-                if(ckey>=key) return ckey==key;
+                int c=compare(curr,so,key);
+                if(c>=0) return c==0;
                 prev=&(curr->next);
             } else {
                 if(prev->ptr.CAS(this,curr,next)) {
@@ -402,17 +534,83 @@ bool MontageLfHashTable<K,V,idxSize>::findNode(MarkPtr* &prev, Node* &curr, Node
     }
 }
 
-/* Specialization for strings */
+template <class K, class V, int idxSize> 
+std::atomic<typename MontageLfHashTable<K,V,idxSize>::Node*>& MontageLfHashTable<K,V,idxSize>::bucketSlot(size_t b){
+    int s=(b==0)?0:64-__builtin_clzll(b);
+    size_t base=(s==0)?0:(1ULL<<(s-1));
+    std::atomic<Node*>* seg=segments[s].load();
+    if(seg==nullptr){
+        std::atomic<Node*>* fresh=new std::atomic<Node*>[(s==0)?1:base]();
+        if(segments[s].compare_exchange_strong(seg,fresh)){
+            seg=fresh;
+        } else {
+            delete[] fresh;
+        }
+    }
+    return seg[b-base];
+}
+
+template <class K, class V, int idxSize> 
+typename MontageLfHashTable<K,V,idxSize>::Node* MontageLfHashTable<K,V,idxSize>::getBucket(size_t b, int tid){
+    std::atomic<Node*>& slot=bucketSlot(b);
+    Node* dummy=slot.load();
+    if(dummy!=nullptr) return dummy;
+    // link a dummy for b right after the one of its parent, i.e. b
+    // without its most significant bit.
+    Node* parent=getBucket(b&~(1ULL<<(63-__builtin_clzll(b))),tid);
+    dummy=new Node(this,so_dummy(b));
+    MarkPtr* prev=nullptr;
+    Node* curr;
+    Node* next;
+    while(true){
+        if(search(&parent->next,dummy->so_key,dummy->key,prev,curr,next,tid)){
+            // someone else linked it.
+            delete dummy;
+            dummy=curr;
+            break;
+        }
+        dummy->next.ptr.store(this,curr);
+        if(prev->ptr.CAS(this,curr,dummy)) break;
+    }
+    slot.store(dummy);
+    return dummy;
+}
+
+// account for an added (d=1) or removed (d=-1) key, and every now and
+// then double the bucket count if the load factor is exceeded.
+template <class K, class V, int idxSize> 
+void MontageLfHashTable<K,V,idxSize>::count_key(int tid, int64_t d){
+    int64_t old=counts[tid%counts.size()].ui.fetch_add(d,std::memory_order_relaxed);
+    if(d<0 || (old&63)!=0) return;
+    int64_t total=0;
+    for(auto& c : counts){
+        total+=c.ui.load(std::memory_order_relaxed);
+    }
+    size_t s=size.load();
+    if(total>load_factor*s && s<(1ULL<<62)){
+        size.compare_exchange_strong(s,s*2);
+    }
+}
+
+/* Specialization for strings: key and val are sized exactly */
 #include <string>
-#include "InPlaceString.hpp"
+#include "VarStringPBlk.hpp"
 template <>
-class MontageLfHashTable<std::string, std::string>::Payload : public pds::PBlk{
-    GENERATE_FIELD(pds::InPlaceString<TESTS_KEY_SIZE>, key, Payload);
-    GENERATE_FIELD(pds::InPlaceString<TESTS_VAL_SIZE>, val, Payload);
-
+class MontageLfHashTable<std::string, std::string>::Payload :
+    public pds::VarStringPBlk<MontageLfHashTable<std::string, std::string>::Payload, 2>{
 public:
-    Payload(std::string k, std::string v) : m_key(this, k), m_val(this, v){}
-    Payload(const Payload& oth) : pds::PBlk(oth), m_key(this, oth.m_key), m_val(this, oth.m_val){}
+    using VarStringPBlk::size_of;
+    Payload(const std::string& k, const std::string& v) : VarStringPBlk({k, v}){}
+    Payload(const Payload& oth, int i, std::string_view s) : VarStringPBlk(oth, i, s){}
+    static size_t size_of(const std::string& k, const std::string& v){
+        return VarStringPBlk::size_of({k, v});
+    }
+    std::string get_key(Recoverable* ds) const {return get_str(ds, 0);}
+    std::string get_unsafe_key(Recoverable* ds) const {return get_unsafe_str(ds, 0);}
+    std::string get_val(Recoverable* ds) const {return get_str(ds, 1);}
+    std::string get_unsafe_val(Recoverable* ds) const {return get_unsafe_str(ds, 1);}
+    std::string_view get_unsafe_val_view(Recoverable* ds) const {return get_unsafe_view(ds, 1);}
+    Payload* set_val(Recoverable* ds, const std::string& v){return set_str(ds, 1, v);}
     void persist(){}
 };
 
@@ -7,12 +7,16 @@
 #include <atomic>
 #include <algorithm>
 #include <functional>
+#include <mutex>
+#include <thread>
 #include <vector>
 #include <utility>
+#include <type_traits>
 
 #include "HarnessUtils.hpp"
 #include "ConcurrentPrimitives.hpp"
 #include "RMap.hpp"
+#include "ReadGuard.hpp"
 #include "RCUTracker.hpp"
 
 template<class K, class V>
@@ -110,6 +114,9 @@ private:
 
     int bg_should_delete = 1;
     std::thread background_thread;
+    // held by the background thread for each round, and by link_sorted
+    // while it rebuilds the levels underneath it.
+    std::mutex bg_lock;
 
     RCUTracker tracker;
     GlobalTestConfig* gtc;
@@ -143,15 +150,18 @@ private:
     int internal_finish_contains(const K& key, Node *node, Payload *node_payload, optional<V>& ret_value);
     int internal_finish_delete(const K& key, Node *node, Payload* node_payload, optional<V>& ret_value, int tid);
     int internal_finish_insert(const K& key, V &val, Node *node, Payload* node_payload, Node* next, Payload*& lazy_payload);
-    bool internal_do_operation(operation_type optype, const K& key, optional<V>& val, optional<V>& ret_value, int tid, Payload *suggest_payload = nullptr);
+    // CONTAINS with contained set stores the payload found (or nullptr)
+    // there instead of copying its value out, and leaves the tracker op
+    // open for the caller to end.
+    bool internal_do_operation(operation_type optype, const K& key, optional<V>& val, optional<V>& ret_value, int tid, Payload *suggest_payload = nullptr, Payload** contained = nullptr);
+    static void end_view(void* ds, void* arg, int tid);
+    void link_sorted(const std::vector<std::pair<K, Payload*>>& items);
 public:
-    MontageLfSkipList(GlobalTestConfig* gtc) : Recoverable(gtc), tracker(gtc->task_num + 1, 100, 1000, true), gtc(gtc) {
+    MontageLfSkipList(GlobalTestConfig* gtc) : Recoverable(gtc, true), tracker(gtc->task_num + 1, 100, 1000, true), gtc(gtc) {
         int bg_tid = gtc->task_num;
+        recover();
         bg_state.store(background_state::RUNNING);
         background_thread = std::move(std::thread(&MontageLfSkipList::bg_loop, this, bg_tid));
-        if (get_recovered_pblks()) {
-            recover();
-        }
     };
     ~MontageLfSkipList(){
         recover_mode(); // PDELETE --> noop
@@ -188,72 +198,67 @@ public:
     }
 
     int recover(){
-        should_cas_verify.store(false);
-
-        int rec_cnt = 0;
-        int rec_thd_count = gtc->task_num;
-        if (gtc->checkEnv("RecoverThread")){
-            rec_thd_count = stoi(gtc->getEnv("RecoverThread"));
-        }
-        std::unordered_map<uint64_t, pds::PBlk*>* recovered = get_recovered_pblks();
-
-        std::vector<Payload*> payloadVector;
-        payloadVector.reserve(recovered->size());
         auto begin = chrono::high_resolution_clock::now();
-        for (auto itr = recovered->begin(); itr != recovered->end(); itr++){
-            rec_cnt++;
-            Payload* payload = reinterpret_cast<Payload*>(itr->second);
-            payloadVector.push_back(payload);
+        auto recovered = recover_sorted<Payload>([this](Payload* p){
+            return (K)p->get_unsafe_key(this);
+        });
+        for (size_t i = 1; i < recovered.size(); i++){
+            if (recovered[i].first == recovered[i-1].first){
+                errexit("conflicting keys recovered.");
+            }
+        }
+        if (recovered.empty()){
+            return 0;
         }
+        link_sorted(recovered);
         auto end = chrono::high_resolution_clock::now();
-        auto dur = end - begin;
-        auto dur_ms_vec = std::chrono::duration_cast<std::chrono::milliseconds>(dur).count();
-        std::cout << "Spent " << dur_ms_vec << "ms building vector" << std::endl;
+        auto dur_ms = std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count();
+        std::cout << "Spent " << dur_ms << "ms building(" << recovered.size() << ")" << std::endl;
+        return recovered.size();
+    }
 
-        begin = chrono::high_resolution_clock::now();
-        std::vector<std::thread> workers;
-        for (int rec_tid = 0; rec_tid < rec_thd_count; rec_tid++) {
-            workers.emplace_back(std::thread([&, rec_tid]() {
-                Recoverable::init_thread(rec_tid);
-                hwloc_set_cpubind(gtc->topology,
-                                  gtc->affinities[rec_tid]->cpuset,
-                                  HWLOC_CPUBIND_THREAD);
-                for (size_t i = rec_tid; i < payloadVector.size(); i += rec_thd_count) {
-                    // re-insert payload.
-                    K key = payloadVector[i]->get_unsafe_key(this);
-                    V val = payloadVector[i]->get_unsafe_val(this);
-                    while (true) {
-                        optional<V> res = {};
-                        optional<V> unused = {};
-                        if(internal_do_operation(operation_type::CONTAINS, key, unused, res, rec_tid)){
-                            errexit("conflicting keys recovered.");
-                        } else {
-                            optional<V> val_opt = val;
-                            if(internal_do_operation(operation_type::INSERT, key, val_opt, unused, rec_tid, payloadVector[i])){
-                                break;
-                            } else {
-                                cout << "Hmm!" << endl;
-                            }
-                        }
-                    }
-                }
-            }));
+    // Builds the list in one pass instead of inserting key by key; for
+    // duplicate keys the first one wins.
+    int bulk_load(std::function<bool(std::pair<K,V>&)> next, int tid){
+        if (head.ptr.load()->next.ptr.load(this) != nullptr){
+            return -1;
+        }
+        std::vector<std::pair<K, V>> kvs;
+        std::pair<K, V> kv;
+        while (next(kv)){
+            kvs.push_back(std::move(kv));
         }
-        for (auto& worker : workers) {
-            if (worker.joinable()) {
-                worker.join();
+        std::stable_sort(kvs.begin(), kvs.end(),
+            [](const std::pair<K, V>& a, const std::pair<K, V>& b){
+                return a.first < b.first;
+            });
+        kvs.erase(std::unique(kvs.begin(), kvs.end(),
+            [](const std::pair<K, V>& a, const std::pair<K, V>& b){
+                return a.first == b.first;
+            }), kvs.end());
+
+        std::vector<std::pair<K, Payload*>> items;
+        items.reserve(kvs.size());
+        const size_t chunk = 1024;
+        for (size_t i = 0; i < kvs.size(); i += chunk){
+            // keep each epoch's batch of new payloads bounded
+            MontageOpHolder _holder(this);
+            for (size_t j = i; j < std::min(i + chunk, kvs.size()); j++){
+                items.emplace_back(kvs[j].first, this->pnew<Payload>(kvs[j].first, kvs[j].second));
             }
         }
-        end = chrono::high_resolution_clock::now();
-        dur = end - begin;
-        auto dur_ms_ins = std::chrono::duration_cast<std::chrono::milliseconds>(dur).count();
-        std::cout << "Spent " << dur_ms_ins << "ms inserting(" << recovered->size() << ")" << std::endl;
-
-        should_cas_verify.store(true);
-        return rec_cnt;
+        link_sorted(items);
+        return items.size();
     }
 
     optional<V> get(K key, int tid);
+    // zero-copy get for string values; see ReadGuard. The guard holds
+    // the tracker reservation, so the payload, which is never written
+    // in place, stays put.
+    bool has_view(){
+        return std::is_same<V, std::string>::value;
+    }
+    ReadGuard get_view(K key, int tid);
     optional<V> remove(K key, int tid);
     optional<V> put(K key, V val, int tid);
     bool insert(K key, V val, int tid);
@@ -267,6 +272,67 @@ class MontageLfSkipListFactory : public RideableFactory{
     }
 };
 
+// Links nodes for items, which must be sorted by key without duplicates,
+// into an empty list. Node j gets ctz(j+1) index levels, so each index
+// level holds every other node of the one below and the successor of
+// every node is known up front; nodes are created and linked in parallel.
+template<class K, class V>
+void MontageLfSkipList<K,V>::link_sorted(const std::vector<std::pair<K, Payload*>>& items){
+    const size_t n = items.size();
+    if (n == 0)
+        return;
+    std::lock_guard<std::mutex> lk(bg_lock);
+    Node *local_head = head.ptr.load();
+    if (local_head->next.ptr.load(this) != nullptr)
+        errexit("MontageLfSkipList must be empty to link sorted nodes.");
+
+    auto level_of = [](size_t j){
+        return std::min((unsigned long)__builtin_ctzll(j + 1), (unsigned long)(MAX_LEVELS - 1));
+    };
+    std::vector<Node*> nodes(n);
+    int thd = std::max(1, std::min(get_rec_thd(), (int)(n / 1024) + 1));
+    auto run = [&](std::function<void(size_t, size_t)> f){
+        std::vector<std::thread> workers;
+        for (int t = 0; t < thd; t++){
+            workers.emplace_back([&, t](){
+                f(n * t / thd, n * (t + 1) / thd);
+            });
+        }
+        for (auto& w : workers){
+            w.join();
+        }
+    };
+    run([&](size_t lo, size_t hi){
+        for (size_t j = lo; j < hi; j++){
+            nodes[j] = new Node(items[j].first, items[j].second, nullptr, nullptr, level_of(j));
+            nodes[j]->raise_or_remove.store(nodes[j]->level > 0);
+        }
+    });
+    run([&](size_t lo, size_t hi){
+        for (size_t j = lo; j < hi; j++){
+            Node *node = nodes[j];
+            node->prev.ptr.store(j == 0 ? local_head : nodes[j - 1]);
+            node->next.ptr.store(this, j + 1 < n ? nodes[j + 1] : nullptr);
+            // index level i+1 lives in succs[i] and links every 2^(i+1)th node
+            for (unsigned long i = 0; i < node->level; i++){
+                size_t succ = j + (1UL << (i + 1));
+                node->succs[i].ptr.store(succ < n ? nodes[succ] : nullptr);
+            }
+        }
+    });
+
+    // the tallest node is the one at the largest power of two <= n
+    unsigned long max_level = level_of((1UL << (63 - __builtin_clzll(n))) - 1);
+    sl_zero.store(0);
+    for (int i = 0; i < MAX_LEVELS; i++){
+        size_t first = (1UL << (i + 1)) - 1;
+        local_head->succs[i].ptr.store(
+            ((unsigned long)i < max_level && first < n) ? nodes[first] : nullptr);
+    }
+    local_head->level = max_level + 1;
+    local_head->next.ptr.store(this, nodes[0]);
+}
+
 template<class K, class V>
 void MontageLfSkipList<K,V>::bg_loop(int tid){
     Node *local_head  = head.ptr.load();
@@ -284,6 +350,7 @@ void MontageLfSkipList<K,V>::bg_loop(int tid){
         if (bg_state.load() == background_state::FINISHED)
             break;
 
+        std::lock_guard<std::mutex> lk(bg_lock);
         zero = sl_zero.load();
 
         bg_non_deleted = 0;
@@ -653,7 +720,7 @@ int MontageLfSkipList<K,V>::internal_finish_insert(const K& key, V &val, Node *n
 }
 
 template<class K, class V>
-bool MontageLfSkipList<K,V>::internal_do_operation(operation_type optype, const K& key, optional<V>& val, optional<V>& ret_value, int tid, Payload *suggest_payload){
+bool MontageLfSkipList<K,V>::internal_do_operation(operation_type optype, const K& key, optional<V>& val, optional<V>& ret_value, int tid, Payload *suggest_payload, Payload** contained){
     Node *item = nullptr, *next_item = nullptr;
     Node *node = nullptr;
     Node* next;
@@ -705,7 +772,11 @@ bool MontageLfSkipList<K,V>::internal_do_operation(operation_type optype, const
             }
         }
         if (nullptr == next || next->key > key) {
-            if (CONTAINS == optype)
+            if (CONTAINS == optype && contained != nullptr){
+                result = (key == node->key) && (nullptr != node_payload);
+                *contained = result ? node_payload : nullptr;
+            }
+            else if (CONTAINS == optype)
                 result = internal_finish_contains(key, node, node_payload, ret_value);
             else if (DELETE == optype)
                 result = internal_finish_delete(key, node, node_payload, ret_value, tid);
@@ -721,7 +792,8 @@ bool MontageLfSkipList<K,V>::internal_do_operation(operation_type optype, const
     if(optype == INSERT && insert_payload != nullptr && result == false){
         this->preclaim(insert_payload);
     }
-    tracker.end_op(tid);
+    if (contained == nullptr)
+        tracker.end_op(tid);
 
     return result;
 }
@@ -743,6 +815,28 @@ optional<V> MontageLfSkipList<K,V>::get(K key, int tid)
     return res;
 }
 
+template<class K, class V>
+ReadGuard MontageLfSkipList<K,V>::get_view(K key, int tid)
+{
+    if constexpr (!std::is_same<V, std::string>::value) {
+        return ReadGuard();
+    } else {
+        optional<V> unused = {};
+        Payload* payload = nullptr;
+        internal_do_operation(operation_type::CONTAINS, key, unused, unused, tid, nullptr, &payload);
+        ReadGuard res(&end_view, this, nullptr, tid);
+        if (payload != nullptr)
+            res.set(payload->get_unsafe_val_view(this));
+        return res;
+    }
+}
+
+template<class K, class V>
+void MontageLfSkipList<K,V>::end_view(void* ds, void* arg, int tid)
+{
+    ((MontageLfSkipList*)ds)->tracker.end_op(tid);
+}
+
 template<class K, class V>
 optional<V> MontageLfSkipList<K,V>::remove(K key, int tid)
 {
@@ -783,6 +877,10 @@ class MontageLfSkipList<std::string, std::string>::Payload : public pds::PBlk{
 public:
     Payload(std::string k, std::string v) : m_key(this, k), m_val(this, v){}
     Payload(const Payload& oth) : pds::PBlk(oth), m_key(this, oth.m_key), m_val(this, oth.m_val){}
+    std::string_view get_unsafe_val_view(Recoverable* ds) const {
+        const Payload* p = ds->openread_pblk_unsafe(this);
+        return std::string_view(p->m_val.c_str(), p->m_val.size());
+    }
     void persist(){}
 };
 
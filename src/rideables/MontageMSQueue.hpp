@@ -35,6 +35,7 @@ private:
         Node(MontageMSQueue* ds_, T v): ds(ds_), next(nullptr), payload(ds_->pnew<Payload>(v)){
             // assert(ds->epochs[EpochSys::tid].ui == NULL_EPOCH);
         }
+        Node(MontageMSQueue* ds_, Payload* p): ds(ds_), next(nullptr), payload(p){} // for recovery
 
         void set_sn(uint64_t s){
             assert(payload!=nullptr && "payload shouldn't be null");
@@ -59,21 +60,37 @@ private:
 
 public:
     MontageMSQueue(GlobalTestConfig* gtc): 
-        Recoverable(gtc), global_sn(0), head(nullptr), tail(nullptr), 
+        Recoverable(gtc, true), global_sn(0), head(nullptr), tail(nullptr), 
         tracker(gtc->task_num, 100, 1000, true){
 
         Node* dummy = new Node(this);
         head.store(this,dummy);
         tail.store(dummy);
+        recover();
     }
 
     void init_thread(GlobalTestConfig* gtc, LocalTestConfig* ltc){
         Recoverable::init_thread(gtc, ltc);
     }
 
+    // rebuild the queue behind the dummy from payloads sorted by sn.
+    // An enqueue takes a new sn on every retry, so sn order is the
+    // order nodes were linked in.
     int recover(){
-        errexit("recover of MontageMSQueue not implemented.");
-        return 0;
+        auto recovered = recover_sorted<Payload>([this](Payload* p){
+            return (uint64_t)p->get_unsafe_sn(this);
+        });
+        Node* last = tail.load();
+        for (auto& r : recovered){
+            Node* n = new Node(this, r.second);
+            last->next.store(this, n);
+            last = n;
+        }
+        tail.store(last);
+        if (!recovered.empty()){
+            global_sn.store(recovered.back().first + 1);
+        }
+        return recovered.size();
     }
 
     ~MontageMSQueue(){};
@@ -160,17 +177,25 @@ class MontageMSQueueFactory : public RideableFactory{
     }
 };
 
-/* Specialization for strings */
+/* Specialization for strings: val is sized exactly */
 #include <string>
-#include "InPlaceString.hpp"
+#include "VarStringPBlk.hpp"
 template <>
-class MontageMSQueue<std::string>::Payload : public pds::PBlk{
-    GENERATE_FIELD(pds::InPlaceString<TESTS_VAL_SIZE>, val, Payload);
+class MontageMSQueue<std::string>::Payload :
+    public pds::VarStringPBlk<MontageMSQueue<std::string>::Payload, 1>{
     GENERATE_FIELD(uint64_t, sn, Payload); 
 
 public:
-    Payload(std::string v) : m_val(this, v), m_sn(0){}
-    Payload(const Payload& oth) : pds::PBlk(oth), m_val(this, oth.m_val), m_sn(oth.m_sn){}
+    using VarStringPBlk::size_of;
+    Payload(const std::string& v) : VarStringPBlk({v}), m_sn(0){}
+    Payload(const Payload& oth, int i, std::string_view s) : VarStringPBlk(oth, i, s), m_sn(oth.m_sn){}
+    static size_t size_of(const std::string& v){
+        return VarStringPBlk::size_of({v});
+    }
+    std::string get_val(Recoverable* ds) const {return get_str(ds, 0);}
+    std::string get_unsafe_val(Recoverable* ds) const {return get_unsafe_str(ds, 0);}
+    std::string_view get_unsafe_val_view(Recoverable* ds) const {return get_unsafe_view(ds, 0);}
+    Payload* set_val(Recoverable* ds, const std::string& v){return set_str(ds, 0, v);}
     void persist(){}
 };
 
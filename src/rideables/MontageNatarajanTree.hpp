@@ -36,6 +36,8 @@ private:
 
         Node(MontageNatarajanTree* ds_, K k, V val, Node* l=nullptr, Node* r=nullptr):
             ds(ds_), level(finite),left(l),right(r),key(k),payload(ds_->pnew<Payload>(key, val)){ };
+        Node(MontageNatarajanTree* ds_, K k, Payload* p):
+            ds(ds_), level(finite),left(nullptr),right(nullptr),key(k),payload(p){ }; // for recovery
         Node(MontageNatarajanTree* ds_, Level lev, Node* l=nullptr, Node* r=nullptr):
             ds(ds_), level(lev),left(l),right(r),key(),payload(nullptr){
             assert(lev != finite && "use constructor with another signature for concrete nodes!");
@@ -147,15 +149,18 @@ private:
     void seek(K key, int tid);
     bool cleanup(K key, int tid);
     void retire_path(Node* start, Node* end, int tid);
+    template<typename Entry>
+    Node* build(const std::vector<Entry>& leaves, size_t lo, size_t hi, int depth);
     // void doRangeQuery(Node& k1, Node& k2, int tid, Node* root, std::map<K,V>& res);
 public:
     MontageNatarajanTree(GlobalTestConfig* gtc):
-        Recoverable(gtc), tracker(gtc->task_num, 100, 1000, true){
+        Recoverable(gtc, true), tracker(gtc->task_num, 100, 1000, true){
         r.right.store(this,new Node(this,inf2));
         r.left.store(this,&s);
         s.right.store(this,new Node(this,inf1));
         s.left.store(this,new Node(this,inf0));
         records = new padded<SeekRecord>[gtc->task_num]{};
+        recover();
     };
     ~MontageNatarajanTree(){};
 
@@ -163,9 +168,27 @@ public:
         Recoverable::init_thread(gtc, ltc);
     }
 
+    // bulk-build a balanced tree under s.left from the payloads
+    // sorted by key, the same shape inserts would leave: the finite
+    // subtree to the left of an inf0 internal node, with the inf0
+    // leaf on its right.
     int recover(){
-        errexit("recover of MontageNatarajanTree not implemented.");
-        return 0;
+        auto recovered = recover_sorted<Payload>([this](Payload* p){
+            return (K)p->get_unsafe_key(this);
+        });
+        if (recovered.empty()){
+            return 0;
+        }
+        for (size_t i = 1; i < recovered.size(); i++){
+            if (recovered[i].first == recovered[i-1].first){
+                errexit("conflicting keys recovered.");
+            }
+        }
+        Node* inf0_leaf = s.left.load(this);
+        Node* top = new Node(this,inf0);
+        top->set(this,inf0,build(recovered,0,recovered.size(),0),inf0_leaf);
+        s.left.store(this,top);
+        return recovered.size();
     }
 
     optional<V> get(K key, int tid);
@@ -270,6 +293,34 @@ bool MontageNatarajanTree<K,V>::cleanup(K key, int tid){
     return res;
 }
 
+// build the subtree of leaves [lo, hi). An internal node keeps the
+// smallest key of its right subtree, as insert does. The top levels
+// are built by parallel threads.
+template <class K, class V>
+template <typename Entry>
+typename MontageNatarajanTree<K,V>::Node* MontageNatarajanTree<K,V>::build(
+    const std::vector<Entry>& leaves, size_t lo, size_t hi, int depth){
+    if (hi - lo == 1){
+        return new Node(this, leaves[lo].first, leaves[lo].second);
+    }
+    size_t mid = lo + (hi - lo) / 2;
+    Node* left = nullptr;
+    Node* right = nullptr;
+    if ((1 << depth) < get_rec_thd() && hi - lo > 1024){
+        std::thread t([&](){
+            left = build(leaves, lo, mid, depth + 1);
+        });
+        right = build(leaves, mid, hi, depth + 1);
+        t.join();
+    } else {
+        left = build(leaves, lo, mid, depth + 1);
+        right = build(leaves, mid, hi, depth + 1);
+    }
+    Node* n = new Node(this, inf2);
+    n->set(this, leaves[mid].first, left, right);
+    return n;
+}
+
 // retire everything on the path [start, end]
 template <class K, class V>
 void MontageNatarajanTree<K,V>::retire_path(Node* start, Node* end, int tid){
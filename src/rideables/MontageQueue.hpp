@@ -38,6 +38,7 @@ private:
         // Node(): next(nullptr){}; 
         Node(MontageQueue* ds_, T v, uint64_t n=0): 
             ds(ds_), next(nullptr), payload(ds_->pnew<Payload>(v, n)), val(v){};
+        Node(MontageQueue* ds_, Payload* p): ds(ds_), next(nullptr), payload(p){}; // for recovery
         // Node(T v, uint64_t n): next(nullptr), val(v){};
 
         void set_sn(uint64_t s){
@@ -67,7 +68,8 @@ private:
 
 public:
     MontageQueue(GlobalTestConfig* gtc): 
-        Recoverable(gtc), global_sn(0), head(nullptr), tail(nullptr){
+        Recoverable(gtc, true), global_sn(0), head(nullptr), tail(nullptr){
+        recover();
     }
 
     ~MontageQueue(){};
@@ -76,9 +78,25 @@ public:
         Recoverable::init_thread(gtc, ltc);
     }
 
+    // rebuild the queue from payloads sorted by sn, which follows
+    // the enqueue order.
     int recover(){
-        errexit("recover of MontageQueue not implemented.");
-        return 0;
+        auto recovered = recover_sorted<Payload>([this](Payload* p){
+            return (uint64_t)p->get_unsafe_sn(this);
+        });
+        for (auto& r : recovered){
+            Node* n = new Node(this, r.second);
+            if (tail == nullptr){
+                head = tail = n;
+            } else {
+                tail->next = n;
+                tail = n;
+            }
+        }
+        if (!recovered.empty()){
+            global_sn = recovered.back().first + 1;
+        }
+        return recovered.size();
     }
 
     void enqueue(T val, int tid);
@@ -41,6 +41,7 @@ class MontageSSHashTable : public RMap<K, V>, public Recoverable {
         Payload* payload;// TODO: does it have to be atomic?
         Node(MontageSSHashTable* ds_, size_t so, K k, V v, Node *n=nullptr) : ds(ds_), so_k(so), next(n), payload(ds_->pnew<Payload>(k,v)){};
         Node(MontageSSHashTable* ds_, size_t so) : ds(ds_), so_k(so), next(nullptr), payload(nullptr){};
+        Node(MontageSSHashTable* ds_, size_t so, Payload* p) : ds(ds_), so_k(so), next(nullptr), payload(p){}; // for recovery
         ~Node(){
             if(payload)
                 ds->preclaim(payload);
@@ -107,16 +108,20 @@ private:
     inline size_t so_dummykey(size_t key){
         return reverse_bits(key);
     }
-    bool list_insert(MarkPtr *head, Node *node, int tid);
+    // verify is off when relinking recovered nodes outside operations.
+    bool list_insert(MarkPtr *head, Node *node, int tid, bool verify = true);
     bool list_find(MarkPtr *head, size_t so_k, K key, int tid);
     optional<V> list_delete(MarkPtr *head, size_t so_k, K key, int tid);
 
 public:
-    MontageSSHashTable(GlobalTestConfig* gtc) : Recoverable(gtc), tracker(gtc->task_num, 100, 1000, true){
+    MontageSSHashTable(GlobalTestConfig* gtc) : Recoverable(gtc, true), tracker(gtc->task_num, 100, 1000, true){
         buckets = new padded<MarkPtr>[size.load()] {};
-        prev = new padded<MarkPtr*>[gtc->task_num];
-        curr = new padded<Node*>[gtc->task_num];
-        next = new padded<Node*>[gtc->task_num];
+        // recovery threads use these too.
+        int thd_num = std::max(gtc->task_num, get_rec_thd());
+        prev = new padded<MarkPtr*>[thd_num];
+        curr = new padded<Node*>[thd_num];
+        next = new padded<Node*>[thd_num];
+        recover();
     };
     ~MontageSSHashTable(){};
 
@@ -124,9 +129,27 @@ public:
         Recoverable::init_thread(gtc, ltc);
     }
 
+    // re-link a recovered payload. Thread-safe.
+    void reinsert(Payload* payload, int tid){
+        K key = (K)payload->key;
+        size_t hashed = myhash(key);
+        Node* node = new Node(this, so_regularkey(hashed), payload);
+        int bucket = hashed % size;
+        if (buckets[bucket].ui.ptr.load(this) == nullptr) {
+            initialize_bucket(bucket,tid);
+        }
+        if (!list_insert(&(buckets[bucket].ui), node, tid, false)) {
+            errexit("conflicting keys recovered.");
+        }
+        count.fetch_add(1);
+    }
+
     int recover(){
-        errexit("recover of MontageSSHashTable not implemented.");
-        return 0;
+        // payloads are streamed to us by the recovery threads of
+        // EpochSys as soon as they are known to survive.
+        return recover_stream([this](pds::PBlk* blk, int rec_tid){
+            reinsert(reinterpret_cast<Payload*>(blk), rec_tid);
+        });
     }
 
     optional<V> get(K key, int tid);
@@ -153,7 +176,8 @@ void MontageSSHashTable<K, V>::initialize_bucket(int bucket, int tid)
     }
 
     Node* dummy = new Node(this,so_dummykey(bucket));
-    if (!list_insert(&(buckets[parent].ui), dummy, tid)) {
+    // dummies are transient, so they are linked with plain CAS.
+    if (!list_insert(&(buckets[parent].ui), dummy, tid, false)) {
         delete dummy;
         dummy = curr[tid].ui;
     }
@@ -262,7 +286,7 @@ bool MontageSSHashTable<K, V>::list_find(MarkPtr* head, size_t so_k, K key, int
 }
 
 template <class K, class V>
-bool MontageSSHashTable<K, V>::list_insert(MarkPtr *head, Node *node, int tid){
+bool MontageSSHashTable<K, V>::list_insert(MarkPtr *head, Node *node, int tid, bool verify){
     bool res = false;
     K key = node->get_key();
 
@@ -273,7 +297,8 @@ bool MontageSSHashTable<K, V>::list_insert(MarkPtr *head, Node *node, int tid){
         } else {
             //does not exist, insert.
             node->next.ptr.store(this,curr[tid].ui);
-            if (prev[tid].ui->ptr.CAS_verify(this, curr[tid].ui, node)) {
+            if (verify ? prev[tid].ui->ptr.CAS_verify(this, curr[tid].ui, node) :
+                prev[tid].ui->ptr.CAS(this, curr[tid].ui, node)) {
                 res = true;
                 break;
             }
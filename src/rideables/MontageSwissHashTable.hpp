@@ -0,0 +1,361 @@
+#ifndef MONTAGE_SWISS_HASHTABLE_HPP
+#define MONTAGE_SWISS_HASHTABLE_HPP
+
+#include "TestConfig.hpp"
+#include "RMap.hpp"
+#include "CustomTypes.hpp"
+#include "ConcurrentPrimitives.hpp"
+#include "Recoverable.hpp"
+#include <emmintrin.h>
+#include <mutex>
+#include <vector>
+
+// Open-addressed Swiss-table index in DRAM over Montage payloads.
+// Slots come in groups of 16, each with a 1-byte control tag: empty,
+// deleted, or the low 7 bits of the key's hash. A probe compares the
+// 16 tags of a group with one SSE2 instruction and reads a payload
+// from NVM only for tags (and cached full hashes) that match.
+//
+// The table is split into 2^SHARD_BITS shards, each an independent
+// Swiss table with its own lock, which grows on its own; the top
+// bits of the hash pick the shard, so a key's shard never changes.
+template<typename K, typename V>
+class MontageSwissHashTable : public RMap<K,V>, public Recoverable{
+public:
+    class Payload : public pds::PBlk{
+        GENERATE_FIELD(K, key, Payload);
+        GENERATE_FIELD(V, val, Payload);
+    public:
+        Payload(){}
+        Payload(K x, V y): m_key(x), m_val(y){}
+        Payload(const Payload& oth): pds::PBlk(oth), m_key(oth.m_key), m_val(oth.m_val){}
+        void persist(){}
+    }__attribute__((aligned(CACHELINE_SIZE)));
+
+private:
+    static const int GROUP = 16;
+    static const int SHARD_BITS = 10;
+    static const int8_t EMPTY = (int8_t)0x80;
+    static const int8_t DELETED = (int8_t)0xFE;
+
+    struct Group{
+        alignas(16) int8_t ctrl[GROUP];
+        // full hash of each slot's key, to rehash and to filter
+        // tag matches without reading NVM.
+        size_t hashes[GROUP];
+        Payload* slots[GROUP];
+        Group(){
+            memset(ctrl, EMPTY, sizeof(ctrl));
+        }
+        // bit i set iff ctrl[i] == c.
+        inline uint32_t match(int8_t c) const {
+            __m128i ctl = _mm_load_si128((const __m128i*)ctrl);
+            return _mm_movemask_epi8(_mm_cmpeq_epi8(ctl, _mm_set1_epi8(c)));
+        }
+        // bit i set iff slot i is empty or deleted.
+        inline uint32_t match_free() const {
+            __m128i ctl = _mm_load_si128((const __m128i*)ctrl);
+            return _mm_movemask_epi8(ctl); // both have the top bit set
+        }
+    };
+
+    struct Shard{
+        std::mutex lock;
+        Group* groups = nullptr;
+        size_t ngroups = 0; // power of 2
+        size_t used = 0;    // full and deleted slots
+        size_t live = 0;    // full slots
+        ~Shard(){
+            delete[] groups;
+        }
+    }__attribute__((aligned(CACHELINE_SIZE)));
+
+    std::hash<K> hash_fn;
+    GlobalTestConfig* gtc;
+    Shard* shards;
+
+    // spread the bits of hash_fn, which may be the identity.
+    inline size_t hash(const K& k) const {
+        uint64_t h = hash_fn(k);
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+    static inline int8_t tag(size_t h){
+        return h & 0x7F;
+    }
+    inline Shard& shard_of(size_t h){
+        return shards[h >> (64 - SHARD_BITS)];
+    }
+    static inline size_t start_group(const Shard& s, size_t h){
+        return (h >> 7) & (s.ngroups - 1);
+    }
+
+    // find key, of hash h, in s. Return true with its group and slot
+    // if found.
+    bool find(Shard& s, const K& key, size_t h, Group*& grp, int& slot){
+        size_t mask = s.ngroups - 1;
+        size_t g = start_group(s, h);
+        for (size_t i = 1; ; i++){
+            grp = &s.groups[g];
+            uint32_t m = grp->match(tag(h));
+            while (m){
+                slot = __builtin_ctz(m);
+                if (grp->hashes[slot] == h &&
+                    (K)grp->slots[slot]->get_unsafe_key(this) == key){
+                    return true;
+                }
+                m &= m - 1;
+            }
+            if (grp->match(EMPTY)){
+                return false;
+            }
+            // triangular probing visits every group of a power-of-2 table.
+            g = (g + i) & mask;
+        }
+    }
+
+    // put a payload of hash h, not in s yet, into the first free slot
+    // on its probe sequence.
+    void place(Shard& s, Payload* p, size_t h){
+        size_t mask = s.ngroups - 1;
+        size_t g = start_group(s, h);
+        for (size_t i = 1; ; i++){
+            Group& grp = s.groups[g];
+            uint32_t m = grp.match_free();
+            if (m){
+                int slot = __builtin_ctz(m);
+                if (grp.ctrl[slot] == EMPTY){
+                    s.used++;
+                }
+                grp.ctrl[slot] = tag(h);
+                grp.hashes[slot] = h;
+                grp.slots[slot] = p;
+                s.live++;
+                return;
+            }
+            g = (g + i) & mask;
+        }
+    }
+
+    // make room for one more key, keeping at most 7/8 of the slots in
+    // use so that every probe ends at an empty slot. Deleted slots are
+    // dropped on the way; payloads are not touched.
+    void reserve(Shard& s){
+        if ((s.used + 1) * 8 <= s.ngroups * GROUP * 7){
+            return;
+        }
+        Group* old = s.groups;
+        size_t old_n = s.ngroups;
+        if ((s.live + 1) * 16 > s.ngroups * GROUP * 7){
+            s.ngroups *= 2;
+        }
+        s.groups = new Group[s.ngroups];
+        s.used = 0;
+        s.live = 0;
+        for (size_t g = 0; g < old_n; g++){
+            for (int i = 0; i < GROUP; i++){
+                if (old[g].ctrl[i] >= 0){
+                    place(s, old[g].slots[i], old[g].hashes[i]);
+                }
+            }
+        }
+        delete[] old;
+    }
+
+    void erase(Shard& s, Group* grp, int slot){
+        // a group with an empty slot already ends every probe through
+        // it, so the slot can go back to empty rather than deleted.
+        if (grp->match(EMPTY)){
+            grp->ctrl[slot] = EMPTY;
+            s.used--;
+        } else {
+            grp->ctrl[slot] = DELETED;
+        }
+        s.live--;
+    }
+
+public:
+    // HashInitSize (1M by default) is the initial number of slots,
+    // spread over the shards.
+    MontageSwissHashTable(GlobalTestConfig* gtc_): Recoverable(gtc_, true), gtc(gtc_){
+        size_t init_size = 1 << 20;
+        if (gtc->checkEnv("HashInitSize")){
+            init_size = stoull(gtc->getEnv("HashInitSize"));
+        }
+        size_t ngroups = 1;
+        while ((ngroups << SHARD_BITS) * GROUP < init_size){
+            ngroups *= 2;
+        }
+        shards = new Shard[1 << SHARD_BITS];
+        for (int i = 0; i < (1 << SHARD_BITS); i++){
+            shards[i].ngroups = ngroups;
+            shards[i].groups = new Group[ngroups];
+        }
+        recover();
+    }
+
+    ~MontageSwissHashTable(){
+        snapshot();
+        // clear transient structures; payloads stay.
+        delete[] shards;
+    }
+
+    void init_thread(GlobalTestConfig* gtc, LocalTestConfig* ltc){
+        Recoverable::init_thread(gtc, ltc);
+    }
+
+    optional<V> get(K key, int tid){
+        size_t h = hash(key);
+        Shard& s = shard_of(h);
+        std::lock_guard<std::mutex> lk(s.lock);
+        Group* grp;
+        int slot;
+        if (find(s, key, h, grp, slot)){
+            return (V)grp->slots[slot]->get_unsafe_val(this);
+        }
+        return {};
+    }
+
+    optional<V> put(K key, V val, int tid){
+        Payload* p = pnew<Payload>(key, val);
+        size_t h = hash(key);
+        Shard& s = shard_of(h);
+        std::lock_guard<std::mutex> lk(s.lock);
+        MontageOpHolder _holder(this);
+        Group* grp;
+        int slot;
+        if (find(s, key, h, grp, slot)){
+            optional<V> ret = (V)grp->slots[slot]->get_unsafe_val(this);
+            grp->slots[slot] = grp->slots[slot]->set_val(this, val);
+            pdelete(p);
+            return ret;
+        }
+        reserve(s);
+        place(s, p, h);
+        return {};
+    }
+
+    bool insert(K key, V val, int tid){
+        Payload* p = pnew<Payload>(key, val);
+        size_t h = hash(key);
+        Shard& s = shard_of(h);
+        std::lock_guard<std::mutex> lk(s.lock);
+        MontageOpHolder _holder(this);
+        Group* grp;
+        int slot;
+        if (find(s, key, h, grp, slot)){
+            pdelete(p);
+            return false;
+        }
+        reserve(s);
+        place(s, p, h);
+        return true;
+    }
+
+    optional<V> replace(K key, V val, int tid){
+        assert(false && "replace not implemented yet.");
+        return {};
+    }
+
+    optional<V> remove(K key, int tid){
+        size_t h = hash(key);
+        Shard& s = shard_of(h);
+        std::lock_guard<std::mutex> lk(s.lock);
+        MontageOpHolder _holder(this);
+        Group* grp;
+        int slot;
+        if (find(s, key, h, grp, slot)){
+            Payload* p = grp->slots[slot];
+            optional<V> ret = (V)p->get_unsafe_val(this);
+            erase(s, grp, slot);
+            pdelete(p);
+            return ret;
+        }
+        return {};
+    }
+
+    // apply f to every payload in the table. Not thread-safe.
+    template<typename F>
+    void for_each_payload(F f){
+        for (int i = 0; i < (1 << SHARD_BITS); i++){
+            Shard& s = shards[i];
+            for (size_t g = 0; g < s.ngroups; g++){
+                for (int j = 0; j < GROUP; j++){
+                    if (s.groups[g].ctrl[j] >= 0){
+                        f(s.groups[g].slots[j]);
+                    }
+                }
+            }
+        }
+    }
+
+    // record all payloads in the table, if snapshot is enabled, so
+    // that restart from this exit needn't scan the heap.
+    void snapshot(){
+        if (!snapshot_enabled()){
+            return;
+        }
+        std::vector<pds::PBlk*> live;
+        for_each_payload([&](Payload* p){
+            live.push_back(p);
+        });
+        write_snapshot(live);
+    }
+
+    // re-link a recovered payload. Thread-safe.
+    void reinsert(Payload* p, int rec_tid){
+        K key = (K)p->get_unsafe_key(this);
+        size_t h = hash(key);
+        Shard& s = shard_of(h);
+        std::lock_guard<std::mutex> lk(s.lock);
+        Group* grp;
+        int slot;
+        if (find(s, key, h, grp, slot)){
+            errexit("conflicting keys recovered.");
+        }
+        reserve(s);
+        place(s, p, h);
+    }
+
+    int recover(){
+        // payloads are streamed to us by the recovery threads of
+        // EpochSys as soon as they are known to survive.
+        return recover_stream([this](pds::PBlk* blk, int rec_tid){
+            reinsert(reinterpret_cast<Payload*>(blk), rec_tid);
+        });
+    }
+};
+
+template <class T>
+class MontageSwissHashTableFactory : public RideableFactory{
+    Rideable* build(GlobalTestConfig* gtc){
+        return new MontageSwissHashTable<T,T>(gtc);
+    }
+};
+
+/* Specialization for strings: key and val are sized exactly */
+#include <string>
+#include "VarStringPBlk.hpp"
+template <>
+class MontageSwissHashTable<std::string, std::string>::Payload :
+    public pds::VarStringPBlk<MontageSwissHashTable<std::string, std::string>::Payload, 2>{
+public:
+    using VarStringPBlk::size_of;
+    Payload(const std::string& k, const std::string& v) : VarStringPBlk({k, v}){}
+    Payload(const Payload& oth, int i, std::string_view s) : VarStringPBlk(oth, i, s){}
+    static size_t size_of(const std::string& k, const std::string& v){
+        return VarStringPBlk::size_of({k, v});
+    }
+    std::string get_key(Recoverable* ds) const {return get_str(ds, 0);}
+    std::string get_unsafe_key(Recoverable* ds) const {return get_unsafe_str(ds, 0);}
+    std::string get_val(Recoverable* ds) const {return get_str(ds, 1);}
+    std::string get_unsafe_val(Recoverable* ds) const {return get_unsafe_str(ds, 1);}
+    Payload* set_val(Recoverable* ds, const std::string& v){return set_str(ds, 1, v);}
+    void persist(){}
+};
+
+#endif
@@ -0,0 +1,177 @@
+#ifndef ATOMICSCOPETEST_HPP
+#define ATOMICSCOPETEST_HPP
+
+/*
+ * This is a test of EpochDomain::AtomicScope across a crash: keys
+ * start out in one of two maps of a domain, and threads keep moving
+ * them to the other map inside scopes. A child process runs the
+ * moves and is killed while scopes are in flight, without any sync.
+ * The domain is then recovered, and every key must be in exactly one
+ * of the maps: none lost and none duplicated by a half-made move.
+ */
+
+#include <atomic>
+#include <random>
+#include <thread>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "TestConfig.hpp"
+#include "EpochDomain.hpp"
+
+template <class M>
+class AtomicScopeTest : public Test{
+public:
+    EpochDomain* domain = nullptr;
+    M* from = nullptr;
+    M* to = nullptr;
+    uint64_t range;
+    pid_t child = -1;
+    // shared with the child: whether it has seeded the maps and
+    // started moving, and how many scopes it has finished.
+    struct Progress{
+        std::atomic<bool> started;
+        std::atomic<uint64_t> scopes;
+    };
+    Progress* progress = nullptr;
+    AtomicScopeTest(uint64_t range): range(range){}
+    void init(GlobalTestConfig* gtc);
+    int execute(GlobalTestConfig* gtc, LocalTestConfig* ltc);
+    void cleanup(GlobalTestConfig* gtc);
+
+    void open(GlobalTestConfig* gtc);
+    void close();
+    // body of the child: seed, then move keys until killed.
+    void run_child(GlobalTestConfig* gtc);
+    std::string fromInt(uint64_t v){
+        auto _key = std::to_string(v);
+        return "user"+std::string(TESTS_KEY_SIZE-_key.size()-4,'0')+_key;
+    }
+};
+
+template <class M>
+void AtomicScopeTest<M>::open(GlobalTestConfig* gtc){
+    domain = new EpochDomain(gtc);
+    from = domain->template create<M>("from", gtc);
+    to = domain->template create<M>("to", gtc);
+    static_cast<Recoverable*>(from)->init_thread(0);
+    static_cast<Recoverable*>(to)->init_thread(0);
+}
+
+template <class M>
+void AtomicScopeTest<M>::close(){
+    delete from;
+    delete to;
+    delete domain;
+}
+
+template <class M>
+void AtomicScopeTest<M>::init(GlobalTestConfig* gtc){
+    if (gtc->checkEnv("range")){
+        range = stoull(gtc->getEnv("range"));
+    }
+    void* shared = mmap(nullptr, sizeof(Progress), PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED){
+        errexit("AtomicScopeTest failed to map progress.");
+    }
+    progress = new (shared) Progress();
+    progress->started.store(false);
+    progress->scopes.store(0);
+    // the domain is only opened in the child, so that the heap is
+    // left as the kill leaves it for cleanup() to recover.
+    child = fork();
+    if (child < 0){
+        errexit("AtomicScopeTest failed to fork.");
+    } else if (child == 0){
+        run_child(gtc);
+        _exit(0);
+    }
+}
+
+template <class M>
+void AtomicScopeTest<M>::run_child(GlobalTestConfig* gtc){
+    open(gtc);
+    // every key in exactly one map, durable before any move.
+    for (uint64_t i = 0; i < range; i++){
+        std::string k = fromInt(i);
+        if (!from->get(k, 0) && !to->get(k, 0)){
+            from->insert(k, k, 0);
+        }
+    }
+    domain->sync();
+    std::vector<std::thread> workers;
+    for (int tid = 0; tid < gtc->task_num; tid++){
+        workers.emplace_back([this, tid](){
+            static_cast<Recoverable*>(from)->init_thread(tid);
+            static_cast<Recoverable*>(to)->init_thread(tid);
+            std::mt19937_64 gen_k(tid);
+            while (true){
+                std::string k = fromInt(gen_k() % range);
+                // move k to the other map, both ops in one epoch.
+                EpochDomain::AtomicScope scope(domain);
+                if (auto v = from->remove(k, tid)){
+                    to->put(k, *v, tid);
+                } else if ((v = to->remove(k, tid))){
+                    from->put(k, *v, tid);
+                }
+                progress->scopes.fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+    }
+    progress->started.store(true);
+    for (auto& w : workers){
+        w.join();
+    }
+}
+
+template <class M>
+int AtomicScopeTest<M>::execute(GlobalTestConfig* gtc, LocalTestConfig* ltc){
+    if (ltc->tid != 0){
+        return 0;
+    }
+    // let the child move keys for the test interval, then crash it.
+    while (!progress->started.load() || progress->scopes.load() == 0 ||
+        std::chrono::high_resolution_clock::now() < gtc->finish){
+        int status;
+        if (waitpid(child, &status, WNOHANG) == child){
+            std::cout<<"child exited before the crash."<<std::endl;
+            std::cout<<"Test FAILED!"<<std::endl;
+            exit(1);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    kill(child, SIGKILL);
+    waitpid(child, nullptr, 0);
+    std::cout<<"crashed."<<std::endl;
+    return progress->scopes.load();
+}
+
+template <class M>
+void AtomicScopeTest<M>::cleanup(GlobalTestConfig* gtc){
+    std::cout<<"scopes:"<<progress->scopes.load()<<std::endl;
+    munmap(progress, sizeof(Progress));
+    open(gtc);
+    std::cout<<"recover returned."<<std::endl;
+    for (uint64_t i = 0; i < range; i++){
+        std::string k = fromInt(i);
+        auto f = from->get(k, 0);
+        auto t = to->get(k, 0);
+        if (f.has_value() == t.has_value()){
+            std::cout<<"key:"<<k<<(f ? " in both maps." : " in neither map.")<<std::endl;
+            std::cout<<"Test FAILED!"<<std::endl;
+            exit(1);
+        }
+        if ((f ? *f : *t) != k){
+            std::cout<<"key:"<<k<<" has a wrong value."<<std::endl;
+            std::cout<<"Test FAILED!"<<std::endl;
+            exit(1);
+        }
+    }
+    std::cout<<"every key in exactly one map."<<std::endl;
+    std::cout<<"Test PASSED!"<<std::endl;
+    close();
+}
+
+#endif
@@ -109,6 +109,7 @@ void ChurnTest::init(GlobalTestConfig* gtc){
 #endif
 
 	allocRideable(gtc);
+	gtc->recorder->addLatencyFields();
 	
 	if(gtc->verbose){
 		printf("Gets:%d Puts:%d Inserts:%d Removes: %d\n",
@@ -137,6 +138,7 @@ int ChurnTest::execute(GlobalTestConfig* gtc, LocalTestConfig* ltc){
 	std::mt19937_64 gen_p(r+1);
 
 	int tid = ltc->tid;
+	LatencyHistogram& lat = gtc->recorder->latency(tid);
 
 	// atomic_thread_fence(std::memory_order_acq_rel);
 	//broker->threadInit(gtc,ltc);
@@ -149,7 +151,9 @@ int ChurnTest::execute(GlobalTestConfig* gtc, LocalTestConfig* ltc){
 		int p = abs((long)gen_p()%100);
 		// int p = abs(rand_nums[(p_idx++)%1000]%100);
 		
+		ticks t0 = getticks();
 		operation(r, p, tid);
+		lat.record(getticks() - t0);
 		
 		ops++;
 		if (ops % 512 == 0){
@@ -18,8 +18,14 @@ public:
 	size_t key_size = TESTS_KEY_SIZE;
 	size_t val_size = TESTS_VAL_SIZE;
 	std::string value_buffer; // for string kv only
-	MapChurnTest(int p_gets, int p_puts, int p_inserts, int p_removes, int range, int prefill):
-		ChurnTest(p_gets, p_puts, p_inserts, p_removes, range, prefill){}
+	// growth workload: start empty and insert every key in [0,range)
+	// once, keys partitioned among threads, until done or time's up.
+	// init_size, if nonzero, is passed to the map as HashInitSize
+	// unless that is set already.
+	bool growth = false;
+	size_t init_size = 0;
+	MapChurnTest(int p_gets, int p_puts, int p_inserts, int p_removes, int range, int prefill, bool growth = false, size_t init_size = 0):
+		ChurnTest(p_gets, p_puts, p_inserts, p_removes, range, prefill), growth(growth), init_size(init_size){}
 	MapChurnTest(int p_gets, int p_puts, int p_inserts, int p_removes, int range):
 		ChurnTest(p_gets, p_puts, p_inserts, p_removes, range){}
 
@@ -43,6 +49,9 @@ public:
         }
         value_buffer += '\0';
 
+		if(init_size != 0 && !gtc->checkEnv("HashInitSize")){
+			gtc->setEnv("HashInitSize", std::to_string(init_size));
+		}
 		ChurnTest::init(gtc);
 	}
 
@@ -84,6 +93,29 @@ public:
 			}
 		}
 	}
+	int execute(GlobalTestConfig* gtc, LocalTestConfig* ltc){
+		if (!growth){
+			return ChurnTest::execute(gtc, ltc);
+		}
+		auto time_up = gtc->finish;
+		int ops = 0;
+		int tid = ltc->tid;
+		LatencyHistogram& lat = gtc->recorder->latency(tid);
+		auto now = std::chrono::high_resolution_clock::now();
+		for (uint64_t key = tid; key < (uint64_t)range; key += gtc->task_num){
+			ticks t0 = getticks();
+			operation(key, this->prop_puts, tid); // always an insert
+			lat.record(getticks() - t0);
+			ops++;
+			if (ops % 512 == 0){
+				now = std::chrono::high_resolution_clock::now();
+				if (std::chrono::duration_cast<std::chrono::microseconds>(time_up - now).count() <= 0){
+					break;
+				}
+			}
+		}
+		return ops;
+	}
 	void operation(uint64_t key, int op, int tid){
 		K k = this->fromInt(key);
 		V v = k;
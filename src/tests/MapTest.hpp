@@ -7,7 +7,14 @@
 
 #include "TestConfig.hpp"
 #include "RMap.hpp"
+#include "ReadGuard.hpp"
+#include <algorithm>
+#include <functional>
 #include <iostream>
+#include <random>
+#include <sstream>
+#include <utility>
+#include <vector>
 #ifdef PRONTO
 #include <signal.h>
 #include "savitar.hpp"
@@ -66,6 +73,15 @@ public:
 	size_t key_size = TESTS_KEY_SIZE;
 	size_t val_size = TESTS_VAL_SIZE;
 	std::string value_buffer; // for string kv only
+	// ValueSizeMix=size:weight,...: string values of mixed sizes,
+	// each size drawn with its weight (1 if left out), in place of
+	// value_buffer. Sizes above TESTS_VAL_SIZE need maps that size
+	// their payloads to the data.
+	std::vector<std::string> mix_values;
+	std::vector<int> mix_weights; // running sums
+	// ZeroCopyGet: gets read values in place through the map's
+	// get_view() rather than copying them out with get().
+	bool zero_copy = false;
     uint64_t total_ops;
     uint64_t* thd_ops;
 	MapTest(int p_gets, int p_puts, int p_inserts, int p_removes, 
@@ -116,6 +132,7 @@ public:
 #endif
 
         getRideable(gtc);
+        gtc->recorder->addLatencyFields();
         
         if(gtc->verbose){
             printf("Gets:%d Puts:%d Inserts:%d Removes: %d\n",
@@ -147,6 +164,12 @@ public:
             value_buffer += (char)((i % 2 == 0 ? 'A' : 'a') + (gen_v() % 26));
         }
         value_buffer += '\0';
+		if(gtc->checkEnv("ValueSizeMix")){
+			parseValueSizeMix(gtc->getEnv("ValueSizeMix"));
+		}
+		if(gtc->checkEnv("ZeroCopyGet")){
+			setupZeroCopyGet();
+		}
 #ifndef PRONTO /* if pronto, we do prefill in parInit */
         doPrefill(gtc);
 #endif
@@ -170,6 +193,42 @@ public:
 			 errexit("MapTest must be run on RMap<K,V> type object.");
 		}
 	}
+	void parseValueSizeMix(const std::string& mix){
+		std::mt19937_64 gen_v(7);
+		std::stringstream ss(mix);
+		std::string item;
+		int sum = 0;
+		while(std::getline(ss, item, ',')){
+			size_t colon = item.find(':');
+			size_t sz = atoi(item.substr(0, colon).c_str());
+			int weight = colon == std::string::npos ? 1 : atoi(item.substr(colon+1).c_str());
+			if(sz == 0 || weight <= 0){
+				errexit("ValueSizeMix takes size:weight,... with positive sizes and weights.");
+			}
+			std::string v;
+			v.reserve(sz);
+			for (size_t i = 0; i < sz - 1; i++) {
+				v += (char)((i % 2 == 0 ? 'A' : 'a') + (gen_v() % 26));
+			}
+			v += '\0';
+			sum += weight;
+			mix_values.push_back(v);
+			mix_weights.push_back(sum);
+		}
+	}
+	void setupZeroCopyGet(){
+		errexit("ZeroCopyGet is only for string maps.");
+	}
+	// the string value to write next.
+	const std::string& pickValue(){
+		if(mix_values.empty()){
+			return value_buffer;
+		}
+		static thread_local std::mt19937_64 gen_s(11);
+		int w = gen_s() % mix_weights.back();
+		size_t i = std::upper_bound(mix_weights.begin(), mix_weights.end(), w) - mix_weights.begin();
+		return mix_values[i];
+	}
 	void doPrefill(GlobalTestConfig* gtc){
 		if (this->prefill > 0){
             /* Wentao: 
@@ -179,10 +238,21 @@ public:
 			// std::mt19937_64 gen_k(0);
 			// int stride = this->range/this->prefill;
 			int i = 0;
-			while(i<this->prefill){
+			int loaded = m->bulk_load([&](std::pair<K,V>& kv){
+				if(i>=this->prefill){
+					return false;
+				}
 				K k = this->fromInt(i%range);
-				m->insert(k,k,0);
+				kv = std::make_pair(k,k);
 				i++;
+				return true;
+			}, 0);
+			if(loaded < 0){
+				while(i<this->prefill){
+					K k = this->fromInt(i%range);
+					m->insert(k,k,0);
+					i++;
+				}
 			}
 			if(gtc->verbose){
 				printf("Prefilled %d\n",i);
@@ -197,11 +267,14 @@ public:
         std::mt19937_64 gen_p(r+1);
 
         int tid = ltc->tid;
+        LatencyHistogram& lat = gtc->recorder->latency(tid);
 
         for (size_t i = 0; i < thd_ops[tid]; i++) {
             r = abs((long)gen_k()%range);
             int p = abs((long)gen_p()%100);
+            ticks t0 = getticks();
             operation(r, p, tid);
+            lat.record(getticks() - t0);
         }
         return thd_ops[tid];
     }
@@ -253,6 +326,14 @@ inline std::string MapTest<std::string,std::string>::fromInt(uint64_t v){
 	return "user"+std::string(key_size-_key.size()-5,'0')+_key; // 31 in total; last one left for terminating null
 }
 
+template<>
+inline void MapTest<std::string,std::string>::setupZeroCopyGet(){
+	if(!m->has_view()){
+		errexit("ZeroCopyGet needs a map with get_view().");
+	}
+	zero_copy = true;
+}
+
 template<>
 inline void MapTest<std::string,std::string>::doPrefill(GlobalTestConfig* gtc){
 	// randomly prefill until specified amount of keys are successfully inserted
@@ -260,10 +341,21 @@ inline void MapTest<std::string,std::string>::doPrefill(GlobalTestConfig* gtc){
 		std::mt19937_64 gen_k(0);
 		// int stride = this->range/this->prefill;
 		int i = 0;
-		while(i<this->prefill){
-			std::string k = this->fromInt(gen_k()%range);
-			m->insert(k,value_buffer,0);
+		int loaded = m->bulk_load([&](std::pair<std::string,std::string>& kv){
+			if(i>=this->prefill){
+				return false;
+			}
+			kv.first = this->fromInt(gen_k()%range);
+			kv.second = pickValue();
 			i++;
+			return true;
+		}, 0);
+		if(loaded < 0){
+			while(i<this->prefill){
+				std::string k = this->fromInt(gen_k()%range);
+				m->insert(k,pickValue(),0);
+				i++;
+			}
 		}
 		if(gtc->verbose){
 			printf("Prefilled %d\n",i);
@@ -277,13 +369,17 @@ inline void MapTest<std::string,std::string>::operation(uint64_t key, int op, in
 	// printf("%d.\n", r);
 	
 	if(op<this->prop_gets){
-		m->get(k,tid);
+		if(zero_copy){
+			ReadGuard g = m->get_view(k,tid);
+		} else {
+			m->get(k,tid);
+		}
 	}
 	else if(op<this->prop_puts){
-		m->put(k,value_buffer,tid);
+		m->put(k,pickValue(),tid);
 	}
 	else if(op<this->prop_inserts){
-		m->insert(k,value_buffer,tid);
+		m->insert(k,pickValue(),tid);
 	}
 	else{ // op<=prop_removes
 		m->remove(k,tid);
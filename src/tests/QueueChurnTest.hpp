@@ -102,6 +102,7 @@ public:
         value_buffer += '\0';
 
         allocRideable(gtc);
+        gtc->recorder->addLatencyFields();
         
         if(gtc->verbose){
             printf("Enqueues:%d Dequeues:%d\n",
@@ -126,6 +127,7 @@ public:
         std::mt19937_64 gen_p(r);
 
         int tid = ltc->tid;
+        LatencyHistogram& lat = gtc->recorder->latency(tid);
 
         // atomic_thread_fence(std::memory_order_acq_rel);
         //broker->threadInit(gtc,ltc);
@@ -136,7 +138,9 @@ public:
             int p = abs((long)gen_p()%100);
             // int p = abs(rand_nums[(p_idx++)%1000]%100);
             
+            ticks t0 = getticks();
             operation(p, tid);
+            lat.record(getticks() - t0);
             
             ops++;
             if (ops % 500 == 0){
@@ -0,0 +1,64 @@
+#ifndef RANGESCANTEST_HPP
+#define RANGESCANTEST_HPP
+
+/*
+ * MapChurnTest with a share of range scans, for ordered maps
+ * (ROrderedMap). A scan starting at a random key k visits keys in
+ * [k, k+ScanLength).
+ */
+
+#include "MapChurnTest.hpp"
+#include "ROrderedMap.hpp"
+#include <vector>
+
+template <class K, class V>
+class RangeScanTest : public MapChurnTest<K,V>{
+public:
+	ROrderedMap<K,V>* omap = nullptr;
+	int p_scans;
+	int scan_len;
+	std::vector<padded<uint64_t>> scanned;
+	// p_scans+p_gets+p_inserts+p_removes should be 100.
+	RangeScanTest(int p_scans, int p_gets, int p_inserts, int p_removes, int range, int prefill, int scan_len = 100):
+		MapChurnTest<K,V>(p_gets, 0, p_inserts, p_removes, range, prefill), p_scans(p_scans), scan_len(scan_len){}
+
+	void init(GlobalTestConfig* gtc){
+		if(gtc->checkEnv("ScanLength")){
+			scan_len = atoi((gtc->getEnv("ScanLength")).c_str());
+		}
+		scanned.resize(gtc->task_num);
+		MapChurnTest<K,V>::init(gtc);
+	}
+
+	void allocRideable(GlobalTestConfig* gtc){
+		MapChurnTest<K,V>::allocRideable(gtc);
+		omap = dynamic_cast<ROrderedMap<K,V>*>(this->m);
+		if (!omap) {
+			errexit("RangeScanTest must be run on ROrderedMap<K,V> type object, e.g. MontageBPlusTree.");
+		}
+	}
+
+	void operation(uint64_t key, int op, int tid){
+		if(op<p_scans){
+			K lo = this->fromInt(key);
+			K hi = this->fromInt(key+scan_len);
+			scanned[tid].ui += omap->range(lo, hi, [](const K&, const V&){}, tid);
+		}
+		else{
+			// the rest of the mix is MapChurnTest's, scaled down.
+			MapChurnTest<K,V>::operation(key, op-p_scans, tid);
+		}
+	}
+
+	void cleanup(GlobalTestConfig* gtc){
+		uint64_t total = 0;
+		for (auto& s : scanned){
+			total += s.ui;
+		}
+		gtc->recorder->addGlobalField("keys_scanned");
+		gtc->recorder->reportGlobalInfo("keys_scanned", (unsigned long)total);
+		MapChurnTest<K,V>::cleanup(gtc);
+	}
+};
+
+#endif
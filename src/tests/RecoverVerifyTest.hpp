@@ -2,11 +2,15 @@
 #define RECOVERVERIFYTEST_HPP
 
 /*
- * This is a test to verify correctness of mappings' recovery.
+ * This is a test to verify correctness of mappings' and queues'
+ * recovery.
  */
 
+#include <deque>
 #include <unordered_map>
 #include "TestConfig.hpp"
+#include "RMap.hpp"
+#include "RQueue.hpp"
 #include "AllocatorMacro.hpp"
 #include "Persistent.hpp"
 #include "Recoverable.hpp"
@@ -15,7 +19,8 @@ template <class K, class V>
 class RecoverVerifyTest : public Test{
 public:
     GlobalTestConfig* _gtc;
-    RMap<K,V>* m;
+    RMap<K,V>* m = nullptr;
+    RQueue<V>* q = nullptr;
     Recoverable* rec;
     size_t ins_cnt = 1000000;
     size_t range = ins_cnt*10;
@@ -26,6 +31,7 @@ public:
     void init(GlobalTestConfig* gtc);
     void parInit(GlobalTestConfig* gtc, LocalTestConfig* ltc);
     int execute(GlobalTestConfig* gtc, LocalTestConfig* ltc);
+    int executeQueue(GlobalTestConfig* gtc, LocalTestConfig* ltc);
     void cleanup(GlobalTestConfig* gtc);
 
     inline K fromInt(uint64_t v);
@@ -34,15 +40,20 @@ public:
 
 template <class K, class V>
 void RecoverVerifyTest<K,V>::parInit(GlobalTestConfig* gtc, LocalTestConfig* ltc){
-    m->init_thread(gtc, ltc);
+    if (m){
+        m->init_thread(gtc, ltc);
+    } else {
+        q->init_thread(gtc, ltc);
+    }
 }
 
 template <class K, class V>
 void RecoverVerifyTest<K,V>::prepareRideable() {
     Rideable* ptr = _gtc->allocRideable();
     m = dynamic_cast<RMap<K,V>*>(ptr);
-    if (!m) {
-        errexit("RecoverVerifyTest must be run on RMap<K,V> type object.");
+    q = dynamic_cast<RQueue<V>*>(ptr);
+    if (!m && !q) {
+        errexit("RecoverVerifyTest must be run on RMap<K,V> or RQueue<V> type object.");
     }
     rec = dynamic_cast<Recoverable*>(ptr);
     if (!rec){
@@ -76,6 +87,9 @@ inline std::string RecoverVerifyTest<std::string,std::string>::fromInt(uint64_t
 
 template <class K, class V>
 int RecoverVerifyTest<K,V>::execute(GlobalTestConfig* gtc, LocalTestConfig* ltc){
+    if (q){
+        return executeQueue(gtc, ltc);
+    }
     std::string value_buffer; // for string kv only
     if (!gtc->checkEnv("NoVerify")){
         if (ltc->tid == 0){ // FIXME: workaround when we can't change the total thread count of ralloc.
@@ -195,9 +209,100 @@ int RecoverVerifyTest<K,V>::execute(GlobalTestConfig* gtc, LocalTestConfig* ltc)
     }
 }
 
+// enqueue distinct values with some dequeues in between, crash, and
+// check that the recovered queue holds the same values in order.
+template <class K, class V>
+int RecoverVerifyTest<K,V>::executeQueue(GlobalTestConfig* gtc, LocalTestConfig* ltc){
+    int tid = ltc->tid;
+    uint64_t r = ltc->seed;
+    std::mt19937_64 gen_p(r+1);
+    size_t ops = 0;
+    if (!gtc->checkEnv("NoVerify")){
+        if (tid != 0){ // FIXME: workaround when we can't change the total thread count of ralloc.
+            return 0;
+        }
+        std::deque<V> reference;
+        uint64_t next_val = 0;
+        auto begin = chrono::high_resolution_clock::now();
+        while(reference.size() < ins_cnt){
+            int p = abs((long)gen_p()%100);
+            if (p < 75){
+                V v = (V)fromInt(next_val++);
+                q->enqueue(v, tid);
+                reference.push_back(v);
+            } else {
+                auto ret1 = q->dequeue(tid);
+                if (ret1.has_value() != !reference.empty() ||
+                    (ret1.has_value() && *ret1 != reference.front())){
+                    std::cout<<"dequeue before crash out of order."<<std::endl;
+                    std::cout<<"Test FAILED!"<<std::endl;
+                    exit(1);
+                }
+                if (ret1.has_value()){
+                    reference.pop_front();
+                }
+            }
+            ops++;
+        }
+        auto end = chrono::high_resolution_clock::now();
+        auto dur_ms = std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count();
+        std::cout<<"enqueue finished. Spent "<< dur_ms << "ms" <<std::endl;
+        rec->flush();
+        std::cout<<"epochsys flushed."<<std::endl;
+        delete q;
+        std::cout<<"crashed."<<std::endl;
+        prepareRideable();
+        std::cout<<"recover returned."<<std::endl;
+        auto rec_cnt = rec->get_last_recovered_cnt();
+        if (rec_cnt == reference.size()){
+            std::cout<<"rec_cnt currect."<<std::endl;
+        } else {
+            std::cout<<"recovered:"<<rec_cnt<<" expecting:"<<reference.size()<<std::endl;
+            std::cout<<"Test FAILED!"<<std::endl;
+            exit(1);
+        }
+        for (auto& v : reference){
+            auto ret = q->dequeue(tid);
+            if (!ret.has_value() || *ret != v){
+                std::cout<<"value:"<<v<<" not recovered in order."<<std::endl;
+                std::cout<<"Test FAILED!"<<std::endl;
+                exit(1);
+            }
+        }
+        std::cout<<"all records recovered in order."<<std::endl;
+        std::cout<<"Test PASSED!"<<std::endl;
+        return ops;
+    } else {
+        // we don't need to verify but just test the speed.
+        size_t thd_ins_cnt = ins_cnt/gtc->task_num;
+        if(tid==0) {
+            thd_ins_cnt+=(ins_cnt-thd_ins_cnt*gtc->task_num);
+        }
+        pthread_barrier_wait(&sync_point);
+        for (size_t i = 0; i < thd_ins_cnt; i++){
+            q->enqueue((V)fromInt(i*gtc->task_num+tid), tid);
+            ops++;
+        }
+        pthread_barrier_wait(&sync_point);
+        if(tid==0){
+            rec->flush();
+            std::cout<<"epochsys flushed."<<std::endl;
+            delete q;
+            std::cout<<"crashed."<<std::endl;
+            prepareRideable();
+            std::cout<<"recover returned."<<std::endl;
+        }
+        return ops;
+    }
+}
+
 template <class K, class V>
 void RecoverVerifyTest<K,V>::cleanup(GlobalTestConfig* gtc){
-    delete m;
+    if (m){
+        delete m;
+    } else {
+        delete q;
+    }
 }
 
 #endif
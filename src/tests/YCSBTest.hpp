@@ -58,6 +58,7 @@ public:
         }
         value_buffer += '\0';
         getRideable(gtc);
+        gtc->recorder->addLatencyFields();
 
         thd_num = to_string(gtc->task_num);
         std::string load_prefix = trace_prefix + "load-" + thd_num + ".";
@@ -127,9 +128,12 @@ public:
         int tid = ltc->tid;
         int ops = 0;
         std::mt19937_64 gen_v(ltc->tid);
+        LatencyHistogram& lat = gtc->recorder->latency(tid);
         
         for (size_t i = 0; i < traces[tid]->size(); i++) {
+            ticks t0 = getticks();
             operation(traces[tid]->at(i), tid, gen_v()&true);
+            lat.record(getticks() - t0);
             ops++;
         }
         return ops;
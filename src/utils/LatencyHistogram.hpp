@@ -0,0 +1,98 @@
+#ifndef LATENCY_HISTOGRAM_HPP
+#define LATENCY_HISTOGRAM_HPP
+
+#include <stdint.h>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#include "getticks.h"
+
+// HDR-style histogram of latencies in rdtsc ticks. Values below
+// 2^SUB_BITS are counted exactly; larger ones keep their SUB_BITS-1
+// highest bits after the leading one, so any recorded value is off
+// by at most 1/32 of itself. Not thread-safe: keep one per thread and
+// merge them afterwards.
+class LatencyHistogram{
+	static const int SUB_BITS = 6;
+	static const uint64_t SUB = 1ULL << SUB_BITS;
+	static const uint64_t HALF = SUB / 2;
+	static const size_t BUCKETS = SUB + (64 - SUB_BITS) * HALF;
+
+	std::vector<uint64_t> counts;
+	uint64_t total = 0;
+	uint64_t max_val = 0;
+
+	static size_t index(uint64_t v){
+		if (v < SUB){
+			return v;
+		}
+		int shift = 63 - __builtin_clzll(v) - SUB_BITS + 1;
+		return SUB + (shift - 1) * HALF + ((v >> shift) - HALF);
+	}
+	// largest value that falls into bucket i
+	static uint64_t highest(size_t i){
+		if (i < SUB){
+			return i;
+		}
+		int shift = (i - SUB) / HALF + 1;
+		uint64_t top = (i - SUB) % HALF + HALF;
+		return ((top + 1) << shift) - 1;
+	}
+public:
+	LatencyHistogram(): counts(BUCKETS, 0){}
+
+	inline void record(ticks t){
+		counts[index(t)]++;
+		total++;
+		max_val = std::max(max_val, (uint64_t)t);
+	}
+	void merge(const LatencyHistogram& oth){
+		for (size_t i = 0; i < BUCKETS; i++){
+			counts[i] += oth.counts[i];
+		}
+		total += oth.total;
+		max_val = std::max(max_val, oth.max_val);
+	}
+	void reset(){
+		std::fill(counts.begin(), counts.end(), 0);
+		total = 0;
+		max_val = 0;
+	}
+	uint64_t count() const{
+		return total;
+	}
+	uint64_t max() const{
+		return max_val;
+	}
+	// smallest recorded latency such that a fraction q of all
+	// samples are no larger; 0 if nothing was recorded.
+	uint64_t percentile(double q) const{
+		if (total == 0){
+			return 0;
+		}
+		uint64_t target = std::max((uint64_t)1, (uint64_t)(q * total + 0.5));
+		uint64_t seen = 0;
+		for (size_t i = 0; i < BUCKETS; i++){
+			seen += counts[i];
+			if (seen >= target){
+				return std::min(highest(i), max_val);
+			}
+		}
+		return max_val;
+	}
+
+	// rdtsc ticks per nanosecond, measured against the steady clock.
+	static double ticks_per_ns(){
+		auto t0 = std::chrono::steady_clock::now();
+		ticks c0 = getticks();
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		ticks c1 = getticks();
+		auto t1 = std::chrono::steady_clock::now();
+		double ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+		return (c1 - c0) / ns;
+	}
+};
+
+#endif
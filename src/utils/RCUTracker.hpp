@@ -187,6 +187,14 @@ public:
 		}
 	}
 		
+	// reclaim everything retired by all threads; only safe when no
+	// thread is in an operation.
+	void empty_all(){
+		for (int i = 0; i<task_num; i++){
+			empty(i);
+		}
+	}
+
 	bool collecting(){return collect;}
 	
 };